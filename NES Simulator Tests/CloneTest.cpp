@@ -0,0 +1,89 @@
+#include "Tests.h"
+#include "TestConsole.h"
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// A console state copied into another console between instructions carries on exactly as the original does:
+// the same registers and cycle count after every instruction, and the same state block at the end
+
+namespace
+{
+	const uint32_t INSTRUCTIONS = 20000;
+
+	void CopyState(TestConsole& from, TestConsole& to)
+	{
+		ConsoleState::Copy(to.state, from.state);
+		to.bus->OnStateLoaded();
+		to.ppu->OnStateLoaded();
+		to.cpu->OnStateLoaded();
+	}
+
+	bool RunBoth(const char* name, TestConsole& original, TestConsole& copy)
+	{
+		for (uint32_t i = 0; i < INSTRUCTIONS; i++)
+		{
+			original.cpu->Step();
+			copy.cpu->Step();
+			CPU_6502* a = original.cpu;
+			CPU_6502* b = copy.cpu;
+			if (a->GetCycleCount() != b->GetCycleCount() || a->GetProgramCounter() != b->GetProgramCounter() ||
+				a->GetA() != b->GetA() || a->GetX() != b->GetX() || a->GetY() != b->GetY() ||
+				a->GetStackPointer() != b->GetStackPointer() || a->GetStatus() != b->GetStatus())
+			{
+				printf("  %s: instruction %u differs, pc $%04X original, $%04X copy\n", name, i, a->GetProgramCounter(), b->GetProgramCounter());
+				return false;
+			}
+		}
+		if (memcmp(original.state, copy.state, sizeof(ConsoleState)) != 0)
+		{
+			printf("  %s: console states differ\n", name);
+			return false;
+		}
+		return true;
+	}
+
+	bool RunClones(const char* rom, bool mapped)
+	{
+		TestConsole original(rom, mapped), copy(rom, mapped);
+
+		// The copy is somewhere else entirely when the state arrives: further on, with caches of its own and
+		// part way through an instruction
+		for (int i = 0; i < 3000; i++)
+		{
+			copy.cpu->Step();
+		}
+		copy.cpu->Clock();
+		for (int i = 0; i < 1000; i++)
+		{
+			original.cpu->Step();
+		}
+		CopyState(original, copy);
+		bool passed = RunBoth("Between instructions", original, copy);
+
+		// Interrupt lines and a DMA halt set between runs are part of the state
+		original.cpu->SetIRQ(CPU_6502::IRQ_EXTERNAL, true);
+		original.cpu->SetNMI(true);
+		CopyState(original, copy);
+		passed &= RunBoth("IRQ and NMI asserted", original, copy);
+
+		original.cpu->SetIRQ(CPU_6502::IRQ_EXTERNAL, false);
+		original.cpu->SetNMI(false);
+		original.cpu->Stall(513, true);
+		CopyState(original, copy);
+		passed &= RunBoth("DMA halt pending", original, copy);
+		return passed;
+	}
+}
+
+bool CloneTest()
+{
+	const char* rom = "CloneTest.nes";
+	if (!WriteRandomROM(rom, 6))
+		return false;
+	bool passed = RunClones(rom, false);
+	passed &= RunClones(rom, true);		// ROM banks left out of the copy
+	remove(rom);
+	return passed;
+}
@@ -0,0 +1,141 @@
+#include "Tests.h"
+#include "TestConsole.h"
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+// The cycle-exact core runs random code to the same registers and RAM as the fast core, instruction by
+// instruction, and takes the documented number of cycles with the documented dummy reads and writes
+
+namespace
+{
+	const uint32_t INSTRUCTIONS = 100000;
+
+	bool RunLockstep(const char* rom)
+	{
+		TestConsole fast(rom), exact(rom);
+		exact.cpu->SetCycleExact(true);
+		for (uint32_t i = 0; i < INSTRUCTIONS; i++)
+		{
+			fast.cpu->Step();
+			exact.cpu->Step();
+			if (!SameState(rom, i, fast, exact, false))		// The fast core keeps the old branch timing
+				return false;
+		}
+		return true;
+	}
+
+	struct TimingCase
+	{
+		const char* name;
+		vector<uint8_t> program;
+		uint16_t start;
+		int setup;			// Instructions run before the one timed
+		uint8_t cycles;
+		uint16_t watch;		// Address the timed instruction reads, or must not read, 0 for none
+		bool read;
+	};
+
+	const TimingCase timingCases[] = {
+		{ "LDA abs,X", { 0xA2, 0x00, 0xBD, 0xFF, 0x10 }, 0x8000, 1, 4, 0x1000, false },
+		{ "LDA abs,X across a page", { 0xA2, 0x01, 0xBD, 0xFF, 0x10 }, 0x8000, 1, 5, 0x1000, true },		// Reads $1000 before $1100
+		{ "LDA abs,Y across a page", { 0xA0, 0x01, 0xB9, 0xFF, 0x10 }, 0x8000, 1, 5, 0x1000, true },
+		{ "STA abs,X", { 0xA2, 0x00, 0x9D, 0x00, 0x10 }, 0x8000, 1, 5, 0x1000, true },		// Reads before it writes
+		{ "LDA (zp),Y", { 0xA9, 0x00, 0x85, 0x10, 0xA9, 0x02, 0x85, 0x11, 0xA0, 0x01, 0xB1, 0x10 }, 0x8000, 5, 5, 0x0200, false },
+		{ "LDA (zp),Y across a page", { 0xA9, 0xFF, 0x85, 0x10, 0xA9, 0x02, 0x85, 0x11, 0xA0, 0x01, 0xB1, 0x10 }, 0x8000, 5, 6, 0x0200, true },
+		{ "LDA zp,X", { 0xA2, 0x01, 0xB5, 0x10 }, 0x8000, 1, 4, 0x0010, true },		// Reads the base while indexing
+		{ "INC abs", { 0xEE, 0x00, 0x03 }, 0x8000, 0, 6, 0, false },
+		{ "INC abs,X", { 0xA2, 0x00, 0xFE, 0x00, 0x03 }, 0x8000, 1, 7, 0, false },
+		{ "ASL A", { 0x0A }, 0x8000, 0, 2, 0x8001, true },		// Reads the next byte
+		{ "PHA", { 0x48 }, 0x8000, 0, 3, 0, false },
+		{ "PLA", { 0x68 }, 0x8000, 0, 4, 0x01FF, true },		// Reads the stack before sp moves
+		{ "JSR", { 0x20, 0x05, 0x80, 0x00, 0x00, 0x60 }, 0x8000, 0, 6, 0, false },
+		{ "RTS", { 0x20, 0x05, 0x80, 0x00, 0x00, 0x60 }, 0x8000, 1, 6, 0, false },
+		{ "BNE not taken", { 0xA2, 0x00, 0xD0, 0x02 }, 0x8000, 1, 2, 0, false },
+		{ "BNE taken", { 0xA2, 0x01, 0xD0, 0x02 }, 0x8000, 1, 3, 0x8004, true },		// Reads the next opcode
+		{ "BNE not taken at a page end", { 0xA2, 0x00, 0xD0, 0x02 }, 0x80FB, 1, 2, 0, false },
+		{ "BNE taken across a page", { 0xA2, 0x01, 0xD0, 0x02 }, 0x80FB, 1, 4, 0x8001, true },		// Target before its high byte is fixed up
+	};
+
+	bool CheckTiming(const TimingCase& timing)
+	{
+		const char* rom = "CycleExactTest.nes";
+		if (!WriteProgramROM(rom, timing.program, timing.start))
+			return false;
+		TestConsole console(rom);
+		remove(rom);
+		CPU_6502* cpu = console.cpu;
+		cpu->SetCycleExact(true);
+		for (int i = 0; i < timing.setup; i++)
+		{
+			cpu->Step();
+		}
+		if (timing.watch)
+			cpu->SetWatchpoint(timing.watch, Bus::WATCH_READ);
+
+		uint64_t start = cpu->GetCycleCount();
+		cpu->Step();
+		uint64_t cycles = cpu->GetCycleCount() - start;
+		bool read = cpu->GetStopReason() == CPU_6502::STOP_WATCHPOINT && cpu->GetStopAddress() == timing.watch;
+		bool passed = true;
+		if (cycles != timing.cycles)
+		{
+			printf("  %s: %llu cycles, expected %u\n", timing.name, (unsigned long long)cycles, timing.cycles);
+			passed = false;
+		}
+		if (timing.watch && read != timing.read)
+		{
+			printf("  %s: $%04X %s\n", timing.name, timing.watch, read ? "read" : "not read");
+			passed = false;
+		}
+		return passed;
+	}
+
+	// Read-modify-write instructions write the value back unchanged before the result, so INC $2007 puts
+	// two bytes into VRAM
+	bool CheckDummyWrite()
+	{
+		const char* rom = "CycleExactTest.nes";
+		const vector<uint8_t> program = { 0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, 0xEE, 0x07, 0x20 };
+		if (!WriteProgramROM(rom, program))
+			return false;
+		TestConsole console(rom);
+		remove(rom);
+		console.cpu->SetCycleExact(true);
+		for (int i = 0; i < 5; i++)
+		{
+			console.cpu->Step();
+		}
+
+		static uint8_t image[0x4000];
+		console.ppu->CaptureVideoPages(image);
+		if (image[0x2000] != 0x00 || image[0x2001] != 0x01)
+		{
+			printf("  INC $2007: VRAM $2000 is $%02X and $2001 is $%02X, expected $00 and $01\n", image[0x2000], image[0x2001]);
+			return false;
+		}
+		return true;
+	}
+}
+
+bool CycleExactTest()
+{
+	bool passed = true;
+	const char* roms[] = { "CycleExactTestA.nes", "CycleExactTestB.nes" };
+	const uint32_t seeds[] = { 6, 10 };
+	for (int i = 0; i < 2; i++)
+	{
+		if (!WriteRandomROM(roms[i], seeds[i]))
+			return false;
+		passed &= RunLockstep(roms[i]);
+		remove(roms[i]);
+	}
+
+	for (const TimingCase& timing : timingCases)
+	{
+		passed &= CheckTiming(timing);
+	}
+	passed &= CheckDummyWrite();
+	return passed;
+}
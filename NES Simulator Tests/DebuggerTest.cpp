@@ -0,0 +1,100 @@
+#include "Tests.h"
+#include "TestConsole.h"
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+// Breakpoints and watchpoints stop the cpu after the instruction they are on, every time round a loop and
+// at no other time, on either core, whether the cpu runs instructions one at a time or in RunUntil batches
+
+namespace
+{
+	// LDA #1, STA $10, JMP $8000: 2 + 3 + 3 cycles a time round
+	const vector<uint8_t> program = { 0xA9, 0x01, 0x85, 0x10, 0x4C, 0x00, 0x80 };
+	const uint64_t LOOP_CYCLES = 8;
+	const int LOOPS = 20;
+
+	struct StopCase
+	{
+		const char* name;
+		uint16_t address;
+		uint8_t watch;			// WatchType bits, 0 for a breakpoint
+		uint16_t pc;			// Where the cpu stops
+		uint8_t data;			// Access that hit the watchpoint
+		uint64_t cycles;		// Cycles into the loop of the stop
+	};
+
+	const StopCase stopCases[] = {
+		{ "Read watchpoint on an opcode", 0x8002, Bus::WATCH_READ, 0x8004, 0x85, 5 },
+		{ "Read watchpoint on an operand", 0x8005, Bus::WATCH_READ, 0x8000, 0x00, 8 },
+		{ "Write watchpoint", 0x0010, Bus::WATCH_WRITE, 0x8004, 0x01, 5 },
+		{ "Breakpoint", 0x8004, 0, 0x8004, 0, 5 },
+	};
+
+	// Runs until something stops the cpu, returns false if nothing does
+	bool RunToStop(CPU_6502* cpu, bool step)
+	{
+		for (int i = 0; i < 100; i++)
+		{
+			if (step)
+				cpu->Step();
+			else
+				cpu->RunUntil(cpu->GetCycleCount() + 100);
+			if (cpu->GetStopReason() != CPU_6502::STOP_NONE)
+				return true;
+		}
+		return false;
+	}
+
+	bool CheckStops(const char* rom, const StopCase& stop, bool exact, bool step)
+	{
+		TestConsole console(rom);
+		CPU_6502* cpu = console.cpu;
+		cpu->SetCycleExact(exact);
+		if (stop.watch)
+			cpu->SetWatchpoint(stop.address, stop.watch);
+		else
+			cpu->SetBreakpoint(stop.address, true);
+
+		const char* how = exact ? (step ? "cycle-exact, stepped" : "cycle-exact") : (step ? "stepped" : "batched");
+		uint64_t start = cpu->GetCycleCount();
+		for (int i = 0; i < LOOPS; i++)
+		{
+			if (!RunToStop(cpu, step))
+			{
+				printf("  %s, %s: no stop %d\n", stop.name, how, i);
+				return false;
+			}
+			CPU_6502::StopReason reason = stop.watch ? CPU_6502::STOP_WATCHPOINT : CPU_6502::STOP_BREAKPOINT;
+			uint64_t cycles = cpu->GetCycleCount() - start;
+			bool data = !stop.watch || (cpu->GetStopData() == stop.data && cpu->GetStopType() == stop.watch);
+			if (cpu->GetStopReason() != reason || cpu->GetStopAddress() != stop.address || !data ||
+				cpu->GetProgramCounter() != stop.pc || cycles != stop.cycles + i * LOOP_CYCLES)
+			{
+				printf("  %s, %s: stop %d at $%04X, pc $%04X, data $%02X, cycle %llu\n", stop.name, how, i,
+					cpu->GetStopAddress(), cpu->GetProgramCounter(), cpu->GetStopData(), (unsigned long long)cycles);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+bool DebuggerTest()
+{
+	const char* rom = "DebuggerTest.nes";
+	if (!WriteProgramROM(rom, program))
+		return false;
+	bool passed = true;
+	for (const StopCase& stop : stopCases)
+	{
+		for (int exact = 0; exact < 2; exact++)
+		{
+			passed &= CheckStops(rom, stop, exact != 0, false);
+			passed &= CheckStops(rom, stop, exact != 0, true);
+		}
+	}
+	remove(rom);
+	return passed;
+}
@@ -0,0 +1,116 @@
+#include "Tests.h"
+#include "TestConsole.h"
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// Two consoles running different ROMs on two threads at once have to produce exactly what each does alone
+
+namespace
+{
+	const uint32_t INSTRUCTIONS = 200000;
+
+	struct TraceEntry
+	{
+		uint64_t cycles;
+		uint16_t pc;
+		uint8_t a;
+		uint8_t x;
+		uint8_t y;
+		uint8_t sp;
+		uint8_t p;
+
+		bool operator==(const TraceEntry& other) const
+		{
+			return cycles == other.cycles && pc == other.pc && a == other.a && x == other.x && y == other.y &&
+				sp == other.sp && p == other.p;
+		}
+	};
+
+	struct Run
+	{
+		vector<TraceEntry> trace;
+		uint8_t ram[0x800];
+	};
+
+	void RunConsole(TestConsole* console, Run* run)
+	{
+		run->trace.reserve(INSTRUCTIONS);
+		for (uint32_t i = 0; i < INSTRUCTIONS; i++)
+		{
+			console->cpu->Step();
+			TraceEntry entry;
+			entry.cycles = console->cpu->GetCycleCount();
+			entry.pc = console->cpu->GetProgramCounter();
+			entry.a = console->cpu->GetA();
+			entry.x = console->cpu->GetX();
+			entry.y = console->cpu->GetY();
+			entry.sp = console->cpu->GetStackPointer();
+			entry.p = console->cpu->GetStatus();
+			run->trace.push_back(entry);
+		}
+		console->bus->PeekBlock(0x0000, run->ram, 0x800);
+	}
+
+	bool Compare(const char* name, const Run& solo, const Run& together)
+	{
+		for (uint32_t i = 0; i < INSTRUCTIONS; i++)
+		{
+			if (!(solo.trace[i] == together.trace[i]))
+			{
+				printf("  %s: instruction %u differs, pc $%04X solo, $%04X together\n", name, i, solo.trace[i].pc, together.trace[i].pc);
+				return false;
+			}
+		}
+		if (memcmp(solo.ram, together.ram, sizeof(solo.ram)) != 0)
+		{
+			printf("  %s: RAM differs\n", name);
+			return false;
+		}
+		return true;
+	}
+}
+
+bool MultiInstanceTest()
+{
+	const char* romA = "MultiInstanceTestA.nes";
+	const char* romB = "MultiInstanceTestB.nes";
+	if (!WriteRandomROM(romA, 6) || !WriteRandomROM(romB, 10))		// Seeds whose code wanders through thousands of addresses instead of settling in a loop
+		return false;
+
+	// Each ROM alone
+	Run soloA, soloB;
+	{
+		TestConsole console(romA);
+		RunConsole(&console, &soloA);
+	}
+	{
+		TestConsole console(romB);
+		RunConsole(&console, &soloB);
+	}
+
+	// Both at once
+	Run togetherA, togetherB;
+	{
+		TestConsole consoleA(romA), consoleB(romB);
+		thread threadA(RunConsole, &consoleA, &togetherA);
+		thread threadB(RunConsole, &consoleB, &togetherB);
+		threadA.join();
+		threadB.join();
+	}
+
+	remove(romA);
+	remove(romB);
+
+	bool result = Compare("ROM A", soloA, togetherA);
+	result &= Compare("ROM B", soloB, togetherB);
+	if (soloA.trace.back() == soloB.trace.back())
+	{
+		printf("  the two ROMs ran the same, the test proves nothing\n");
+		result = false;
+	}
+	return result;
+}
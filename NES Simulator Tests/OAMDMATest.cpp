@@ -0,0 +1,85 @@
+#include "Tests.h"
+#include "TestConsole.h"
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+// A write to $4014 copies the page into OAM from OAMADDR on and halts the cpu for 513 cycles, 514 when the
+// halt starts on an odd cycle, however the cpu is being run
+
+namespace
+{
+	enum RunMode { RUN_CYCLES, RUN_CLOCK, RUN_EXACT_CYCLES, RUN_EXACT_CLOCK };
+	const char* const modeNames[] = { "RunCycles", "Clock", "cycle-exact RunCycles", "cycle-exact Clock" };
+
+	// Returns the length of the halt, 0 if it or the OAM is wrong
+	uint32_t RunDMA(const char* rom, RunMode mode, bool odd)
+	{
+		// [LDA $00], LDA #$10, STA $2003, LDA #$02, STA $4014, JMP *. The 3 cycle LDA moves the DMA to the
+		// other parity.
+		vector<uint8_t> program = { 0xA5, 0x00, 0xA9, 0x10, 0x8D, 0x03, 0x20, 0xA9, 0x02, 0x8D, 0x14, 0x40, 0x4C, 0x00, 0x00 };
+		if (!odd)
+			program.erase(program.begin(), program.begin() + 2);
+		uint16_t end = 0x8000 + (uint16_t)program.size() - 3;
+		program[program.size() - 2] = end & 0xFF;
+		program[program.size() - 1] = end >> 8;
+		if (!WriteProgramROM(rom, program))
+			return 0;
+
+		TestConsole console(rom);
+		CPU_6502* cpu = console.cpu;
+		cpu->SetCycleExact(mode == RUN_EXACT_CYCLES || mode == RUN_EXACT_CLOCK);
+		for (int i = 0; i < 0x100; i++)
+		{
+			console.bus->Write(0x0200 + i, (uint8_t)(i ^ 0x5A));
+		}
+
+		// RunCycles can run a pair at a time, so the halt is timed from the start of the program to the JMP
+		uint64_t start = cpu->GetCycleCount() + (odd ? 3 : 0) + 2 + 4 + 2 + 4;		// After the STA $4014
+		while (cpu->GetProgramCounter() != end)
+		{
+			if (mode == RUN_CYCLES || mode == RUN_EXACT_CYCLES)
+				cpu->RunCycles(1);		// Whole instructions and the halt they start
+			else
+				while (!cpu->Clock());
+		}
+		uint32_t halt = (uint32_t)(cpu->GetCycleCount() - start);
+		uint32_t expected = 513 + (start & 1);
+		if (halt != expected)
+		{
+			printf("  %s: halt of %u cycles starting on cycle %llu, expected %u\n", modeNames[mode], halt,
+				(unsigned long long)start, expected);
+			return 0;
+		}
+		for (int i = 0; i < 0x100; i++)
+		{
+			uint8_t data = console.state->oam[(uint8_t)(0x10 + i)];
+			if (data != (uint8_t)(i ^ 0x5A))
+			{
+				printf("  %s: OAM $%02X is $%02X, expected $%02X\n", modeNames[mode], (uint8_t)(0x10 + i), data, (uint8_t)(i ^ 0x5A));
+				return 0;
+			}
+		}
+		return halt;
+	}
+}
+
+bool OAMDMATest()
+{
+	const char* rom = "OAMDMATest.nes";
+	bool passed = true;
+	for (int mode = RUN_CYCLES; mode <= RUN_EXACT_CLOCK; mode++)
+	{
+		uint32_t even = RunDMA(rom, (RunMode)mode, false);
+		uint32_t odd = RunDMA(rom, (RunMode)mode, true);
+		if (even && odd && even == odd)
+		{
+			printf("  %s: both halts start on the same parity\n", modeNames[mode]);
+			passed = false;
+		}
+		passed &= even && odd;
+	}
+	remove(rom);
+	return passed;
+}
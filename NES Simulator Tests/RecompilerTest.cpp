@@ -0,0 +1,68 @@
+#include "Tests.h"
+#include "TestConsole.h"
+#include <cstdio>
+#include <stdexcept>
+
+using namespace std;
+
+// Recompiled blocks leave random code in the same registers and RAM, after the same number of cycles, as
+// the interpreter does running it one instruction at a time, and the checked mode finds nothing to throw about
+
+namespace
+{
+	const uint32_t BLOCKS = 50000;
+
+	bool RunLockstep(const char* rom)
+	{
+		TestConsole recompiled(rom), interpreted(rom);
+		if (!recompiled.cpu->SetRecompilerMode(CPU_6502::RECOMPILER_ON))
+			return true;		// Not on this build or host, nothing to compare
+		for (uint32_t i = 0; i < BLOCKS; i++)
+		{
+			recompiled.cpu->RunUntil(recompiled.cpu->GetCycleCount() + 1);		// One block, or one instruction
+			while (interpreted.cpu->GetCycleCount() < recompiled.cpu->GetCycleCount())
+			{
+				interpreted.cpu->Step();
+			}
+			if (!SameState(rom, i, recompiled, interpreted))
+				return false;
+		}
+		return true;
+	}
+
+	bool RunChecked(const char* rom)
+	{
+		TestConsole console(rom);
+		if (!console.cpu->SetRecompilerMode(CPU_6502::RECOMPILER_CHECKED))
+			return true;
+		try
+		{
+			for (uint32_t i = 0; i < BLOCKS; i++)
+			{
+				console.cpu->RunUntil(console.cpu->GetCycleCount() + 1);
+			}
+		}
+		catch (const logic_error& error)
+		{
+			printf("  %s: %s at $%04X\n", rom, error.what(), console.cpu->GetProgramCounter());
+			return false;
+		}
+		return true;
+	}
+}
+
+bool RecompilerTest()
+{
+	bool passed = true;
+	const char* roms[] = { "RecompilerTestA.nes", "RecompilerTestB.nes", "RecompilerTestC.nes" };
+	const uint32_t seeds[] = { 1, 6, 10 };
+	for (int i = 0; i < 3; i++)
+	{
+		if (!WriteRandomROM(roms[i], seeds[i]))
+			return false;
+		passed &= RunLockstep(roms[i]);
+		passed &= RunChecked(roms[i]);
+		remove(roms[i]);
+	}
+	return passed;
+}
@@ -0,0 +1,80 @@
+#include "Tests.h"
+#include "TestConsole.h"
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+// Fused pairs leave code in the same registers and RAM, after the same number of cycles, as the same two
+// instructions decoded one at a time, through every way a pair's branch can go
+
+namespace
+{
+	const uint32_t STEPS = 50000;
+
+	bool RunLockstep(const char* rom)
+	{
+		TestConsole fused(rom), unfused(rom);
+		if (!unfused.cpu->SetSuperinstructions(false))
+			return true;		// Not on this build, nothing to compare
+		for (uint32_t i = 0; i < STEPS; i++)
+		{
+			fused.cpu->RunUntil(fused.cpu->GetCycleCount() + 1);		// One pair, or one instruction
+			while (unfused.cpu->GetCycleCount() < fused.cpu->GetCycleCount())
+			{
+				unfused.cpu->RunUntil(unfused.cpu->GetCycleCount() + 1);
+			}
+			if (!SameState(rom, i, fused, unfused))
+				return false;
+		}
+		return true;
+	}
+
+	// Every pair with a branch, taken, not taken and across a page both ways, looping back to the start
+	bool WriteBranchROM(const char* rom)
+	{
+		const uint16_t start = 0x80F0;
+		vector<uint8_t> program(0x120, 0xEA);		// NOP between the pieces
+		auto place = [&](uint16_t address, const vector<uint8_t>& code)
+		{
+			copy(code.begin(), code.end(), program.begin() + (address - start));
+		};
+		place(0x80F0, { 0xA2, 0x03, 0x4C, 0xFF, 0x80 });		// LDX #3, JMP $80FF
+		place(0x80FF, { 0xCA, 0xD0, 0xFD });					// DEX, BNE $80FF: back across the page twice, then not taken
+		place(0x8102, { 0xA0, 0x02, 0x88, 0xD0, 0xFD });		// LDY #2, DEY, BNE $8104: taken once on the page
+		place(0x8107, { 0xA9, 0x00, 0x85, 0x10 });				// LDA #0, STA $10
+		place(0x810B, { 0xA5, 0x10, 0xF0, 0x02 });				// LDA $10, BEQ taken
+		place(0x8111, { 0xA5, 0x10, 0xD0, 0x02 });				// LDA $10, BNE not taken
+		place(0x8115, { 0xC9, 0x00, 0xF0, 0x01 });				// CMP #0, BEQ taken
+		place(0x811A, { 0xC9, 0x01, 0xD0, 0x00 });				// CMP #1, BNE taken to the next instruction
+		place(0x811E, { 0xC9, 0x00, 0xD0, 0x02 });				// CMP #0, BNE not taken
+		place(0x8122, { 0x4C, 0xF8, 0x81 });					// JMP $81F8
+		place(0x81F8, { 0xA5, 0x10, 0xF0, 0x04 });				// LDA $10, BEQ $8200: forward across the page
+		place(0x8200, { 0xA9, 0x80, 0x8D, 0x00, 0x03 });		// LDA #$80, STA $0300
+		place(0x8205, { 0xAD, 0x00, 0x03, 0x10, 0x01 });		// LDA $0300, BPL not taken
+		place(0x820A, { 0xC5, 0x10, 0xD0, 0xE2 });				// CMP $10, BNE $81F0: back across the page
+		place(0x81F0, { 0x4C, 0xF0, 0x80 });					// JMP $80F0
+		return WriteProgramROM(rom, program, start);
+	}
+}
+
+bool SuperinstructionTest()
+{
+	bool passed = true;
+	const char* roms[] = { "SuperinstructionTestA.nes", "SuperinstructionTestB.nes", "SuperinstructionTestC.nes" };
+	const uint32_t seeds[] = { 9, 21, 38 };		// Seeds that reach the most opcodes in PRG-ROM
+	for (int i = 0; i < 3; i++)
+	{
+		if (!WriteRandomROM(roms[i], seeds[i]))
+			return false;
+		passed &= RunLockstep(roms[i]);
+		remove(roms[i]);
+	}
+
+	const char* rom = "SuperinstructionTest.nes";
+	if (!WriteBranchROM(rom))
+		return false;
+	passed &= RunLockstep(rom);
+	remove(rom);
+	return passed;
+}
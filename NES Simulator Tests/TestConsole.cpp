@@ -0,0 +1,98 @@
+#include "TestConsole.h"
+#include <fstream>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+using namespace std;
+
+TestConsole::TestConsole(string romFile, bool mapped)
+{
+	state = ConsoleState::Create();
+	memory = new Memory(state);
+	ppu = new PPU(state);
+#ifdef CPU_STATIC_BUS
+	bus = new NESBus(memory, ppu, memory);		// Internal RAM, PPU Registers, Program ROM
+#else
+	bus = new Bus();
+	bus->RegisterDevice(ppu, 0x2000, 2);		// PPU Registers
+	bus->RegisterDevice(memory, 0x8000, 8);		// Program ROM
+	bus->RegisterDevice(memory, 0x0000, 2);		// Internal RAM
+#endif
+	loader = new NESLoader(memory, ppu);
+	if (mapped ? !loader->MapFile(romFile) : !loader->LoadFile(romFile))
+		throw runtime_error("Unable to load " + romFile);
+	bus->RefreshPages(memory);
+	cpu = new CPU_6502(bus, state);
+	dma = new OAMDMA(bus, ppu, cpu);
+	bus->RegisterRegion(dma, 0x4014, 1);		// OAM DMA
+}
+
+TestConsole::~TestConsole()
+{
+	delete dma;
+	delete cpu;
+	delete loader;
+	delete bus;
+	delete ppu;
+	delete memory;
+	ConsoleState::Destroy(state);
+}
+
+static bool WriteImage(string fileName, vector<uint8_t>& image, uint16_t start)
+{
+	image[0] = 'N';
+	image[1] = 'E';
+	image[2] = 'S';
+	image[3] = 0x1A;
+	image[4] = 2;		// 32k of program ROM
+	image[5] = 1;		// 8k of CHR ROM
+	image[16 + 0x7FFC] = start & 0xFF;		// Reset vector
+	image[16 + 0x7FFD] = start >> 8;
+
+	ofstream file(fileName, ios::out | ios::binary);
+	file.write((const char*)image.data(), image.size());
+	return file.good();
+}
+
+bool WriteRandomROM(string fileName, uint32_t seed)
+{
+	vector<uint8_t> image(16 + 0x8000 + 0x2000);
+	for (size_t i = 16; i < image.size(); i++)
+	{
+		seed = seed * 1103515245 + 12345;		// Same on every platform, unlike rand()
+		image[i] = (uint8_t)(seed >> 16);
+	}
+	return WriteImage(fileName, image, 0x8000);
+}
+
+bool WriteProgramROM(string fileName, const vector<uint8_t>& program, uint16_t start)
+{
+	vector<uint8_t> image(16 + 0x8000 + 0x2000);
+	copy(program.begin(), program.end(), image.begin() + 16 + (start & 0x7FFF));
+	return WriteImage(fileName, image, start);
+}
+
+bool SameState(const char* name, uint32_t instruction, TestConsole& a, TestConsole& b, bool cycles)
+{
+	CPU_6502* cpuA = a.cpu;
+	CPU_6502* cpuB = b.cpu;
+	const char* differs = NULL;
+	if (cycles && cpuA->GetCycleCount() != cpuB->GetCycleCount())
+		differs = "cycle count";
+	else if (cpuA->GetProgramCounter() != cpuB->GetProgramCounter())
+		differs = "pc";
+	else if (cpuA->GetA() != cpuB->GetA() || cpuA->GetX() != cpuB->GetX() || cpuA->GetY() != cpuB->GetY())
+		differs = "A, X or Y";
+	else if (cpuA->GetStackPointer() != cpuB->GetStackPointer() || cpuA->GetStatus() != cpuB->GetStatus())
+		differs = "SP or P";
+	else if (memcmp(a.state->ram, b.state->ram, sizeof(a.state->ram)) != 0)
+		differs = "RAM";
+	if (!differs)
+		return true;
+	printf("  %s: %s differs after instruction %u, pc $%04X and $%04X, cycle %llu and %llu\n", name, differs, instruction,
+		cpuA->GetProgramCounter(), cpuB->GetProgramCounter(), (unsigned long long)cpuA->GetCycleCount(), (unsigned long long)cpuB->GetCycleCount());
+	return false;
+}
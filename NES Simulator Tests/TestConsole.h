@@ -0,0 +1,40 @@
+#pragma once
+#include "Bus.h"
+#include "ConsoleState.h"
+#include "Memory.h"
+#include "CPU_6502.h"
+#include "PPU.h"
+#include "NESLoader.h"
+#include "OAMDMA.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// A console wired up the same way as NES, without the window
+class TestConsole
+{
+public:
+	TestConsole(string romFile, bool mapped = false);		// mapped runs the ROM from a shared file mapping, like NES
+	~TestConsole();
+
+	ConsoleState* state;
+	Memory* memory;
+	PPU* ppu;
+	CPU_6502::BusType* bus;
+	NESLoader* loader;
+	CPU_6502* cpu;
+	OAMDMA* dma;
+};
+
+// Writes a 32k PRG / 8k CHR .nes file of pseudo random bytes that starts running at $8000. Random code
+// reaches every opcode and addressing mode and writes all over RAM and the PPU registers.
+bool WriteRandomROM(string fileName, uint32_t seed);
+
+// Same layout with program at start and zeros (BRK) everywhere else, starting at start
+bool WriteProgramROM(string fileName, const vector<uint8_t>& program, uint16_t start = 0x8000);
+
+// Compares the registers and internal RAM of two consoles, and their cycle counts if cycles is set. The
+// first difference is printed under name.
+bool SameState(const char* name, uint32_t instruction, TestConsole& a, TestConsole& b, bool cycles = true);
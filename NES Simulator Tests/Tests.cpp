@@ -0,0 +1,35 @@
+#define OLC_PGE_APPLICATION		// The emulator's sprites and pixels need the engine, NES.cpp isn't part of the tests
+#include "olcPixelGameEngine.h"
+#include "Tests.h"
+#include <cstdio>
+
+struct Test
+{
+	const char* name;
+	bool (*run)();
+};
+
+static const Test tests[] = {
+	{ "CloneTest", CloneTest },
+	{ "CycleExactTest", CycleExactTest },
+	{ "DebuggerTest", DebuggerTest },
+	{ "MultiInstanceTest", MultiInstanceTest },
+	{ "OAMDMATest", OAMDMATest },
+	{ "RecompilerTest", RecompilerTest },
+	{ "SuperinstructionTest", SuperinstructionTest },
+	{ "ThreadedCodeTest", ThreadedCodeTest },
+	{ "VideoPageTest", VideoPageTest },
+};
+
+int main()
+{
+	int failed = 0;
+	for (const Test& test : tests)
+	{
+		bool passed = test.run();
+		printf("%s %s\n", passed ? "PASS" : "FAIL", test.name);
+		if (!passed)
+			failed++;
+	}
+	return failed;
+}
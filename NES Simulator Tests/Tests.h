@@ -0,0 +1,12 @@
+#pragma once
+
+// Each test prints what went wrong and returns false on failure
+bool CloneTest();
+bool CycleExactTest();
+bool DebuggerTest();
+bool MultiInstanceTest();
+bool OAMDMATest();
+bool RecompilerTest();
+bool SuperinstructionTest();
+bool ThreadedCodeTest();
+bool VideoPageTest();
@@ -0,0 +1,46 @@
+#include "Tests.h"
+#include "TestConsole.h"
+#include <cstdio>
+
+using namespace std;
+
+// Threaded code leaves random code in the same registers and RAM, after the same number of cycles, as the
+// interpreter does running it one instruction at a time
+
+namespace
+{
+	const uint32_t THREADS = 50000;
+
+	bool RunLockstep(const char* rom)
+	{
+		TestConsole threaded(rom), interpreted(rom);
+		if (!threaded.cpu->SetThreadedCode(true))
+			return true;		// Not on this build, nothing to compare
+		for (uint32_t i = 0; i < THREADS; i++)
+		{
+			threaded.cpu->RunUntil(threaded.cpu->GetCycleCount() + 1);		// One thread, or one instruction
+			while (interpreted.cpu->GetCycleCount() < threaded.cpu->GetCycleCount())
+			{
+				interpreted.cpu->Step();
+			}
+			if (!SameState(rom, i, threaded, interpreted))
+				return false;
+		}
+		return true;
+	}
+}
+
+bool ThreadedCodeTest()
+{
+	bool passed = true;
+	const char* roms[] = { "ThreadedCodeTestA.nes", "ThreadedCodeTestB.nes", "ThreadedCodeTestC.nes" };
+	const uint32_t seeds[] = { 9, 21, 38 };		// Seeds that reach the most opcodes in PRG-ROM
+	for (int i = 0; i < 3; i++)
+	{
+		if (!WriteRandomROM(roms[i], seeds[i]))
+			return false;
+		passed &= RunLockstep(roms[i]);
+		remove(roms[i]);
+	}
+	return passed;
+}
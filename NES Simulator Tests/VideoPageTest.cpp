@@ -0,0 +1,97 @@
+#include "Tests.h"
+#include "TestConsole.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+// VRAM written through PPUADDR and PPUDATA marks exactly the pages it lands in dirty, and a capture copies
+// those pages and every page mirroring them, leaves the rest alone and starts the next set from nothing
+
+namespace
+{
+	bool CheckDirtyPages(PPU* ppu, const char* when, const uint8_t* expected, int count)
+	{
+		bool passed = true;
+		for (int page = 0; page < 64; page++)
+		{
+			bool dirty = ppu->IsVideoPageDirty(page << 8);
+			bool wanted = find(expected, expected + count, page) != expected + count;
+			if (dirty != wanted)
+			{
+				printf("  %s: page $%04X is %s\n", when, page << 8, dirty ? "dirty" : "clean");
+				passed = false;
+			}
+		}
+		return passed;
+	}
+
+	void WriteVRAM(CPU_6502::BusType* bus, uint16_t address, uint8_t data)
+	{
+		bus->Write(0x2006, address >> 8);
+		bus->Write(0x2006, address & 0xFF);
+		bus->Write(0x2007, data);
+	}
+}
+
+bool VideoPageTest()
+{
+	const char* rom = "VideoPageTest.nes";
+	if (!WriteRandomROM(rom, 1))
+		return false;
+	TestConsole console(rom);		// Nothing runs, only the PPU and the bus are used
+	remove(rom);
+	PPU* ppu = console.ppu;
+	CPU_6502::BusType* bus = console.bus;
+	static uint8_t image[0x4000];
+
+	// Nothing has been captured yet, so the first capture takes every page
+	ppu->CaptureVideoPages(image);
+	if (!CheckDirtyPages(ppu, "after the first capture", NULL, 0))
+		return false;
+
+	bus->Read(0x2002);		// Resets the PPUADDR latch
+	WriteVRAM(bus, 0x0010, 0x5A);		// Pattern table
+	WriteVRAM(bus, 0x2041, 0xAB);		// Nametable
+	bus->Write(0x2007, 0xCD);			// Next address, $2042
+	bus->Write(0x2000, 0x04);			// Increment by 32
+	WriteVRAM(bus, 0x23F0, 0x11);
+	bus->Write(0x2007, 0x12);			// Down a row into the next nametable, $2410
+	bus->Write(0x2000, 0x00);
+	const uint8_t written[] = { 0x00, 0x20, 0x23, 0x24 };
+	bool passed = CheckDirtyPages(ppu, "after the writes", written, sizeof(written));
+
+	memset(image, 0xEE, sizeof(image));
+	uint32_t copied = ppu->CaptureVideoPages(image);
+	passed &= CheckDirtyPages(ppu, "after the capture", NULL, 0);
+
+	// Vertical mirroring: $2000 shows up again at $2800, $3000 and $3800, and $2400 at $2C00
+	const struct { uint16_t address; uint8_t data; } expected[] = {
+		{ 0x0010, 0x5A }, { 0x2041, 0xAB }, { 0x2042, 0xCD }, { 0x2841, 0xAB }, { 0x3042, 0xCD },
+		{ 0x3841, 0xAB }, { 0x23F0, 0x11 }, { 0x2BF0, 0x11 }, { 0x2410, 0x12 }, { 0x2C10, 0x12 },
+		{ 0x0100, 0xEE }, { 0x2100, 0xEE }		// Not written, so not copied
+	};
+	for (const auto& check : expected)
+	{
+		if (image[check.address] != check.data)
+		{
+			printf("  $%04X captured as $%02X, expected $%02X\n", check.address, image[check.address], check.data);
+			passed = false;
+		}
+	}
+	if (copied == 0 || copied > 16)
+	{
+		printf("  %u pages copied\n", copied);
+		passed = false;
+	}
+
+	// A clean capture copies nothing
+	if (ppu->CaptureVideoPages(image) != 0)
+	{
+		printf("  Capture with nothing written copied pages\n");
+		passed = false;
+	}
+
+	return passed;
+}
@@ -1,53 +1,378 @@
 #include "Bus.h"
 #include "BusDevice.h"
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <ostream>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
 
 Bus::Bus()
 {
 	for (int i = 0; i < 16; i++)
-		devices[i] = NULL;
+	{
+		generations[i] = 1;		// 0 is left for cached data that was never filled
+		trackedBlocks[i] = false;
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		dirtyPages[i] = ~(uint64_t)0;		// Nothing has been captured yet
+	}
+	for (int i = 0; i < 256; i++)
+	{
+		pageDevices[i] = NULL;
+		readPages[i] = mappedReadPages[i] = NULL;
+		writePages[i] = mappedWritePages[i] = NULL;
+		watchedPages[i] = 0;
+	}
+	watcher = NULL;
+#ifdef BUS_ACCESS_HEATMAP
+	heatmap.assign(3 << 16, 0);
+#endif
 }
 
-uint8_t Bus::Read(uint16_t address) const
+Bus::~Bus()
 {
+}
+
+uint8_t Bus::ReadDevice(uint16_t address) const
+{
+	if (watchedPages[address >> 8] & WATCH_READ)
+		return ReadWatched(address);
 	const BusDevice* const device = GetRegisteredDevice(address);
 	if (device)
 		return device->Read(address);
 	return 0;	// Default value if address doesn't exist
 }
 
-void Bus::Write(uint16_t address, uint8_t data)
+void Bus::WriteDevice(uint16_t address, uint8_t data)
 {
+	if (watchedPages[address >> 8] & WATCH_WRITE)
+	{
+		WriteWatched(address, data);
+		return;
+	}
 	BusDevice* const device = GetRegisteredDevice(address);
 	if (device)
 		device->Write(address, data);
 }
 
+uint8_t Bus::ReadWatched(uint16_t address) const
+{
+	const uint8_t* const page = mappedReadPages[address >> 8];
+	const BusDevice* const device = GetRegisteredDevice(address);
+	uint8_t data = 0;
+	if (page)
+		data = page[address & 0xFF];
+	else if (device)
+		data = device->Read(address);
+	if ((watchpoints[address] & WATCH_READ) && watcher)
+		watcher->OnWatch(address, data, WATCH_READ);
+	return data;
+}
+
+void Bus::WriteWatched(uint16_t address, uint8_t data)
+{
+	uint8_t* const page = mappedWritePages[address >> 8];
+	BusDevice* const device = GetRegisteredDevice(address);
+	if (page)
+		page[address & 0xFF] = data;
+	else if (device)
+		device->Write(address, data);
+	if ((watchpoints[address] & WATCH_WRITE) && watcher)
+		watcher->OnWatch(address, data, WATCH_WRITE);
+}
+
+uint8_t Bus::Peek(uint16_t address) const
+{
+	const uint8_t* const page = mappedReadPages[address >> 8];
+	if (page)
+		return page[address & 0xFF];
+	const BusDevice* const device = GetRegisteredDevice(address);
+	if (device)
+		return device->Peek(address);
+	return 0;
+}
+
+void Bus::ReadBlock(uint16_t address, uint8_t* data, uint32_t length) const
+{
+	// A page at a time, pages that go to a device (or hold a watchpoint) are read a byte at a time
+	while (length)
+	{
+		uint32_t run = 0x100 - (address & 0xFF);
+		if (run > length)
+			run = length;
+		const uint8_t* const page = readPages[address >> 8];
+		if (page)
+		{
+			memcpy(data, page + (address & 0xFF), run);
+#ifdef BUS_ACCESS_HEATMAP
+			for (uint32_t i = 0; i < run; i++)
+				heatmap[(HEATMAP_READS << 16) | (uint16_t)(address + i)]++;
+#endif
+		}
+		else
+		{
+			for (uint32_t i = 0; i < run; i++)
+				data[i] = Read(address + i);
+		}
+		address += run;		// Wraps around at the top of the address space, the same as the CPU
+		data += run;
+		length -= run;
+	}
+}
+
+void Bus::WriteBlock(uint16_t address, const uint8_t* data, uint32_t length)
+{
+	while (length)
+	{
+		uint32_t run = 0x100 - (address & 0xFF);
+		if (run > length)
+			run = length;
+		uint8_t* const page = writePages[address >> 8];
+		if (page)
+		{
+			memcpy(page + (address & 0xFF), data, run);
+			if (trackedBlocks[address >> 12])
+				Invalidate(address);
+			SetDirty(address);
+#ifdef BUS_ACCESS_HEATMAP
+			for (uint32_t i = 0; i < run; i++)
+				heatmap[(HEATMAP_WRITES << 16) | (uint16_t)(address + i)]++;
+#endif
+		}
+		else
+		{
+			for (uint32_t i = 0; i < run; i++)
+				Write(address + i, data[i]);
+		}
+		address += run;
+		data += run;
+		length -= run;
+	}
+}
+
+void Bus::PeekBlock(uint16_t address, uint8_t* data, uint32_t length) const
+{
+	while (length)
+	{
+		uint32_t run = 0x100 - (address & 0xFF);
+		if (run > length)
+			run = length;
+		const uint8_t* const page = mappedReadPages[address >> 8];
+		if (page)
+			memcpy(data, page + (address & 0xFF), run);
+		else
+		{
+			for (uint32_t i = 0; i < run; i++)
+				data[i] = Peek(address + i);
+		}
+		address += run;
+		data += run;
+		length -= run;
+	}
+}
+
 bool Bus::RegisterDevice(BusDevice* device, uint16_t startAddress, uint8_t addressBlocks)
 {
 	if (addressBlocks < 1 || addressBlocks > 16)
 		return false;
 
-	int index = (startAddress & 0xF000) >> 12;
+	return RegisterRegion(device, startAddress & 0xF000, addressBlocks * 0x1000);
+}
+
+bool Bus::RegisterRegion(BusDevice* device, uint16_t startAddress, uint32_t length)
+{
+	uint32_t end = startAddress + length;
+	if (!device || length < 1 || end > 0x10000)	// Requested address is out of range
+		return false;
+	if (!GetOverlaps(startAddress, length).empty())	// Device already exists at this location
+		return false;
+
+	Region region = { device, startAddress, length };
+	regions.push_back(region);
 
-	// Check that the requested address space is valid and free
-	for (int i = 0; i < addressBlocks; i++)
+	// Assign requested address space to the device
+	for (uint32_t page = startAddress >> 8; page <= (end - 1) >> 8; page++)
 	{
-		if (index + i >= 16)	// Requested address is out of range
-			return false;
-		if (devices[index + i] != NULL)	// Device already exists at this location
-			return false;
+		uint32_t pageStart = page << 8;
+		if (pageStart >= startAddress && pageStart + 0x100 <= end)
+			pageDevices[page] = device;
+		else
+		{
+			if (splitPages[page].empty())
+				splitPages[page].assign(0x100, NULL);
+			uint32_t first = pageStart > startAddress ? pageStart : startAddress;
+			uint32_t last = pageStart + 0x100 < end ? pageStart + 0x100 : end;
+			for (uint32_t address = first; address < last; address++)
+				splitPages[page][address & 0xFF] = device;
+		}
+		LoadPage(page);
 	}
+	return true;
+}
 
-	// Assign requested address space to the device
-	for (int i = 0; i < addressBlocks; i++)
+vector<Bus::Region> Bus::GetOverlaps(uint16_t startAddress, uint32_t length) const
+{
+	vector<Region> overlaps;
+	for (const Region& region : regions)
 	{
-		devices[index + i] = device;
+		if (startAddress < region.start + region.length && region.start < startAddress + length)
+			overlaps.push_back(region);
 	}
-	return true;
+	return overlaps;
+}
+
+void Bus::MapPages(uint16_t startAddress, uint16_t size, const uint8_t* readMemory, uint8_t* writeMemory)
+{
+	if ((startAddress | size) & 0xFF || startAddress + size > 0x10000)
+		throw std::invalid_argument("Pages must be whole and inside the address space");
+
+	for (int offset = 0; offset < size; offset += 0x100)
+	{
+		int page = (startAddress + offset) >> 8;
+		mappedReadPages[page] = readMemory ? readMemory + offset : NULL;
+		mappedWritePages[page] = writeMemory ? writeMemory + offset : NULL;
+		UpdatePage(page);
+		Invalidate(page << 8);
+		SetDirty(page << 8);
+	}
+}
+
+void Bus::RefreshPages(const BusDevice* device)
+{
+	for (int page = 0; page < 256; page++)
+	{
+		if (pageDevices[page] == device)
+			LoadPage(page);
+	}
+}
+
+void Bus::LoadPage(int page)
+{
+	// Shared pages always go to the devices, neither of them can hand out the whole page
+	BusDevice* const device = pageDevices[page];
+	mappedReadPages[page] = device ? device->GetReadPage(page << 8) : NULL;
+	mappedWritePages[page] = device ? device->GetWritePage(page << 8) : NULL;
+	UpdatePage(page);
+	Invalidate(page << 8);
+	SetDirty(page << 8);		// Different memory behind the page
+}
+
+void Bus::UpdatePage(int page)
+{
+	// A watched page leaves the fast path so every access to it reaches the watch check
+	readPages[page] = (watchedPages[page] & WATCH_READ) ? NULL : mappedReadPages[page];
+	writePages[page] = (watchedPages[page] & WATCH_WRITE) ? NULL : mappedWritePages[page];
+}
+
+void Bus::ClearDirty()
+{
+	for (int i = 0; i < 4; i++)
+	{
+		dirtyPages[i] = 0;
+	}
+}
+
+void Bus::OnStateLoaded()
+{
+	for (int block = 0; block < 16; block++)
+	{
+		Invalidate(block << 12);
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		dirtyPages[i] = ~(uint64_t)0;
+	}
+}
+
+uint32_t Bus::CapturePages(uint8_t* image)
+{
+	// Pages that go to a device have no memory to copy, their state is the device's own. A write shows up
+	// in every mirror of its page, so the pages to copy are the ones backed by the same memory as a dirty page.
+	const uint8_t* dirtyMemory[256];
+	int dirtyCount = 0;
+	for (int page = 0; page < 256; page++)
+	{
+		if (IsDirty(page << 8) && mappedReadPages[page])
+			dirtyMemory[dirtyCount++] = mappedReadPages[page];
+	}
+
+	uint32_t copied = 0;
+	for (int page = 0; page < 256 && dirtyCount; page++)
+	{
+		if (!mappedReadPages[page] || find(dirtyMemory, dirtyMemory + dirtyCount, mappedReadPages[page]) == dirtyMemory + dirtyCount)
+			continue;
+		memcpy(image + (page << 8), mappedReadPages[page], 0x100);
+		copied++;
+	}
+	ClearDirty();
+	return copied;
+}
+
+void Bus::SetWatchpoint(uint16_t address, uint8_t types)
+{
+	if (watchpoints.empty())
+		watchpoints.assign(0x10000, 0);
+	watchpoints[address] = types & (WATCH_READ | WATCH_WRITE);
+
+	int page = address >> 8;
+	watchedPages[page] = 0;
+	for (int i = page << 8; i < (page + 1) << 8; i++)
+		watchedPages[page] |= watchpoints[i];
+	UpdatePage(page);
+}
+
+void Bus::SetWatcher(BusWatcher* watcher)
+{
+	this->watcher = watcher;
 }
 
 BusDevice* Bus::GetRegisteredDevice(uint16_t address) const
 {
-	return devices[(address & 0xF000) >> 12];
+	const uint8_t page = address >> 8;
+	if (splitPages[page].empty())
+		return pageDevices[page];
+	return splitPages[page][address & 0xFF];
+}
+
+#ifdef BUS_ACCESS_HEATMAP
+const uint32_t* Bus::GetHeatmap(HeatmapCounter counter) const
+{
+	return &heatmap[counter << 16];
+}
+
+void Bus::ResetHeatmap()
+{
+	heatmap.assign(3 << 16, 0);
+}
+
+void Bus::WriteHeatmap(std::ostream& out, HeatmapFormat format) const
+{
+	if (format == HEATMAP_BINARY)
+	{
+		// Reads, writes and fetches as three runs of 64k counts, in host byte order
+		out.write((const char*)heatmap.data(), heatmap.size() * sizeof(uint32_t));
+		return;
+	}
+
+	// Addresses that were never touched are left out
+	out << "address,reads,writes,fetches\n";
+	for (uint32_t address = 0; address < 0x10000; address++)
+	{
+		uint32_t reads = heatmap[(HEATMAP_READS << 16) | address];
+		uint32_t writes = heatmap[(HEATMAP_WRITES << 16) | address];
+		uint32_t fetches = heatmap[(HEATMAP_FETCHES << 16) | address];
+		if (!reads && !writes && !fetches)
+			continue;
+
+		stringstream ss;
+		ss << "0x" << uppercase << setfill('0') << setw(4) << hex << address;
+		out << ss.str() << ',' << reads << ',' << writes << ',' << fetches << '\n';
+	}
 }
+#endif
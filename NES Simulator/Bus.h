@@ -1,6 +1,12 @@
 #pragma once
 #include "BusDevice.h"
 #include <cstdint>
+#include <vector>
+#include <ostream>
+
+//#define BUS_ACCESS_HEATMAP	// Count reads, writes and opcode fetches per address (see WriteHeatmap)
+
+class BusWatcher;
 
 class Bus
 {
@@ -8,13 +14,198 @@ public:
 	Bus();
 	~Bus();
 
+	enum WatchType : uint8_t
+	{
+		WATCH_READ = 0x01,
+		WATCH_WRITE = 0x02
+	};
+
+	struct Region
+	{
+		BusDevice* device;
+		uint16_t start;
+		uint32_t length;
+	};
+
+#ifdef BUS_ACCESS_HEATMAP
+	enum HeatmapCounter
+	{
+		HEATMAP_READS,
+		HEATMAP_WRITES,
+		HEATMAP_FETCHES
+	};
+
+	enum HeatmapFormat
+	{
+		HEATMAP_CSV,
+		HEATMAP_BINARY
+	};
+#endif
+
 	uint8_t Read(uint16_t address) const;
+	uint8_t Fetch(uint16_t address) const;		// Read of an opcode, counted apart from data reads
 	void Write(uint16_t address, uint8_t data);
+	uint8_t Peek(uint16_t address) const;		// Read without side effects, watchpoints or counting (debuggers)
+	void ReadBlock(uint16_t address, uint8_t* data, uint32_t length) const;	// Same as Read for each byte, memory-backed pages are copied in one go
+	void WriteBlock(uint16_t address, const uint8_t* data, uint32_t length);
+	void PeekBlock(uint16_t address, uint8_t* data, uint32_t length) const;
 	bool RegisterDevice(BusDevice* device, uint16_t startAddress, uint8_t addressBlocks = 1);	// Each address block is 4k (16 blocks in total for 64k)
+	bool RegisterRegion(BusDevice* device, uint16_t startAddress, uint32_t length);	// Any start and length, fails if it overlaps a registered region
+	std::vector<Region> GetOverlaps(uint16_t startAddress, uint32_t length) const;	// Registered regions that share an address with the range
+	void MapPages(uint16_t startAddress, uint16_t size, const uint8_t* readMemory, uint8_t* writeMemory);	// Points whole pages straight at host memory, NULL hands them back to the device
+	void RefreshPages(const BusDevice* device);			// Asks device for its pages again, call after it switches banks
+	uint32_t GetGeneration(uint16_t address) const;		// Changes whenever the block holding address is remapped, or written to while tracked
+	uint32_t TrackGeneration(uint16_t address);			// GetGeneration for filling a cache, has writes to the block change the generation until it next does
+	const uint8_t* GetReadPage(uint16_t address) const;	// Host memory behind the page holding address, NULL if it goes to a device
+	uint8_t* GetWritePage(uint16_t address) const;
+	void Invalidate(uint16_t address);					// Changes the generation of the block holding address, so code cached from it is rebuilt
+	void SetDirty(uint16_t address);					// Marks the page holding address as written, for writes made straight to its memory
+	bool IsDirty(uint16_t address) const;				// Page holding address was written or remapped since the last capture
+	void ClearDirty();
+	void OnStateLoaded();								// Memory changed under the caches, every block gets a new generation and every page is dirty
+	uint32_t CapturePages(uint8_t* image);				// Copies the dirty memory-backed pages into image (64k, by address) and clears them, returns the number copied
+	void SetWatchpoint(uint16_t address, uint8_t types);	// WatchType bits, 0 removes the watchpoint
+	void SetWatcher(BusWatcher* watcher);				// Told about every access to a watched address
+	uint8_t GetWatchTypes(uint16_t address) const;		// WatchType bits of the watchpoints in the page holding address
+#ifdef BUS_ACCESS_HEATMAP
+	const uint32_t* GetHeatmap(HeatmapCounter counter) const;	// One count per address, 64k in all
+	void ResetHeatmap();
+	void WriteHeatmap(std::ostream& out, HeatmapFormat format) const;
+#endif
+
+protected:
+	// Only blocks that code was cached from since their last change are tracked, so plain RAM writes and
+	// writes to data blocks never touch the generations. 0 is skipped on wrap, it marks unfilled entries.
+	uint32_t generations[16];
+	bool trackedBlocks[16];
+	uint64_t dirtyPages[4];		// One bit per 256 byte page, set by writes and cleared by a capture
+
+	// One entry per 256 byte page. Pages backed by plain memory point straight at it, so reads and writes
+	// to them skip the device. Pages with side effects (registers, mapper writes), unmapped pages and
+	// pages holding a watchpoint are NULL and go through ReadDevice and WriteDevice.
+	const uint8_t* readPages[256];
+	uint8_t* writePages[256];
+	uint8_t watchedPages[256];		// WatchType bits of the watchpoints in each page
+#ifdef BUS_ACCESS_HEATMAP
+	// Counters of each HeatmapCounter back to back, indexed by (counter << 16) | address. Every console
+	// has its own bus, so consoles run side by side on several threads never share a counter.
+	mutable std::vector<uint32_t> heatmap;
+#endif
+
+	uint8_t ReadDevice(uint16_t address) const;
+	void WriteDevice(uint16_t address, uint8_t data);
+	uint8_t ReadWatched(uint16_t address) const;
+	void WriteWatched(uint16_t address, uint8_t data);
 
 private:
-	BusDevice* devices[16];
+	std::vector<Region> regions;
+
+	// Device lookup is one table entry per page. A page shared by several regions has no device of its own
+	// and is dispatched on the low byte of the address instead.
+	BusDevice* pageDevices[256];
+	std::vector<BusDevice*> splitPages[256];	// Empty unless the page is shared
+
+	// Memory behind each page whether or not it is watched, readPages and writePages are these
+	// with the watched pages taken out
+	const uint8_t* mappedReadPages[256];
+	uint8_t* mappedWritePages[256];
+	std::vector<uint8_t> watchpoints;		// WatchType bits per address, empty until the first watchpoint
+	BusWatcher* watcher;
 
 	BusDevice* GetRegisteredDevice(uint16_t address) const;
+	void LoadPage(int page);
+	void UpdatePage(int page);
 };
 
+
+// Receives the accesses to watched addresses (see Bus::SetWatchpoint)
+class BusWatcher
+{
+public:
+	virtual ~BusWatcher() {}
+	virtual void OnWatch(uint16_t address, uint8_t data, Bus::WatchType type) = 0;
+};
+
+
+inline uint8_t Bus::Read(uint16_t address) const
+{
+#ifdef BUS_ACCESS_HEATMAP
+	heatmap[(HEATMAP_READS << 16) | address]++;
+#endif
+	const uint8_t* const page = readPages[address >> 8];
+	if (page)
+		return page[address & 0xFF];
+	return ReadDevice(address);
+}
+
+inline uint8_t Bus::Fetch(uint16_t address) const
+{
+#ifdef BUS_ACCESS_HEATMAP
+	heatmap[(HEATMAP_FETCHES << 16) | address]++;
+	const uint8_t* const page = readPages[address >> 8];
+	if (page)
+		return page[address & 0xFF];
+	return ReadDevice(address);
+#else
+	return Read(address);
+#endif
+}
+
+inline void Bus::Write(uint16_t address, uint8_t data)
+{
+#ifdef BUS_ACCESS_HEATMAP
+	heatmap[(HEATMAP_WRITES << 16) | address]++;
+#endif
+	if (trackedBlocks[address >> 12])
+		Invalidate(address);
+	dirtyPages[address >> 14] |= (uint64_t)1 << ((address >> 8) & 0x3F);
+	uint8_t* const page = writePages[address >> 8];
+	if (page)
+		page[address & 0xFF] = data;
+	else
+		WriteDevice(address, data);
+}
+
+inline uint8_t Bus::GetWatchTypes(uint16_t address) const
+{
+	return watchedPages[address >> 8];
+}
+
+inline uint32_t Bus::GetGeneration(uint16_t address) const
+{
+	return generations[(address & 0xF000) >> 12];
+}
+
+inline uint32_t Bus::TrackGeneration(uint16_t address)
+{
+	trackedBlocks[address >> 12] = true;
+	return generations[address >> 12];
+}
+
+inline void Bus::Invalidate(uint16_t address)
+{
+	uint32_t& generation = generations[address >> 12];
+	if (++generation == 0)
+		generation = 1;
+	trackedBlocks[address >> 12] = false;		// Nothing cached from the block is valid any more
+}
+
+inline void Bus::SetDirty(uint16_t address)
+{
+	dirtyPages[address >> 14] |= (uint64_t)1 << ((address >> 8) & 0x3F);
+}
+
+inline bool Bus::IsDirty(uint16_t address) const
+{
+	return (dirtyPages[address >> 14] >> ((address >> 8) & 0x3F)) & 1;
+}
+
+inline const uint8_t* Bus::GetReadPage(uint16_t address) const
+{
+	return readPages[address >> 8];
+}
+
+inline uint8_t* Bus::GetWritePage(uint16_t address) const
+{
+	return writePages[address >> 8];
+}
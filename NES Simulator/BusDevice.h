@@ -4,8 +4,13 @@
 class BusDevice
 {
 public:
+	virtual ~BusDevice() {}
+
 	virtual uint8_t Read(uint16_t address) const = 0;
 	virtual void Write(uint16_t address, uint8_t data) = 0;
+	virtual uint8_t Peek(uint16_t address) const { return Read(address); }	// Read without side effects, for devices whose reads change state
+	virtual const uint8_t* GetReadPage(uint16_t address) { return NULL; }	// Memory behind the 256 byte page holding address, NULL if reads need Read
+	virtual uint8_t* GetWritePage(uint16_t address) { return NULL; }		// Same for writes, NULL if writes have side effects
 	
 protected:
 	const static uint16_t SIZE_1K = 0x0400;
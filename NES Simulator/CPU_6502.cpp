@@ -1,4 +1,8 @@
 #include "CPU_6502.h"
+#include "CPU_6502_Ops.h"
+#include "CPU_6502_MicroOps.h"
+#include "CPU_6502_Recompiler.h"
+#include "CPU_6502_Threaded.h"
 #include "Bus.h"
 #include <iostream>
 #include <string>
@@ -9,17 +13,106 @@
 
 using namespace std;
 
-CPU_6502::CPU_6502(Bus* bus)
+#ifdef CPU_OPCODE_PROFILE
+#define PROFILE_OPCODE(opCode, cycles) CountOpCode(opCode, cycles)
+#else
+#define PROFILE_OPCODE(opCode, cycles) (cycles)
+#endif
+
+#define OPCODE_HANDLER(instruction, mode) CPU_6502::Op<CPU_6502::AddressingMode::mode, CPU_6502::Operation::instruction>
+#define OPCODE_ENTRY(code, instruction, mode, cycles) { &OPCODE_HANDLER(instruction, mode)::Execute, &OPCODE_HANDLER(instruction, mode)::Run, cycles, CPU_6502::AddressingMode::mode::size },
+constexpr CPU_6502::OpCode CPU_6502::opCodes[0x100] = {
+	CPU_6502_OPCODES(OPCODE_ENTRY)
+};
+#undef OPCODE_ENTRY
+#undef OPCODE_HANDLER
+constexpr CPU_6502::OpCodeInfo CPU_6502::opCodeInfo[0x100];
+
+#define READ_ONLY_ENTRY(code, instruction, mode, cycles)															\
+	CPU_6502::Operation::instruction::access == CPU_6502::Operation::ACCESS_READ ||							\
+	(CPU_6502::Operation::instruction::access == CPU_6502::Operation::ACCESS_NONE && MODE_##mode == MODE_IMP),
+constexpr bool CPU_6502::readOnlyOpCodes[0x100] = {
+	CPU_6502_OPCODES(READ_ONLY_ENTRY)
+};
+#undef READ_ONLY_ENTRY
+
+#define ACCESS_TYPE_ENTRY(code, instruction, mode, cycles) CPU_6502::Operation::instruction::access,
+constexpr uint8_t CPU_6502::accessTypes[0x100] = {
+	CPU_6502_OPCODES(ACCESS_TYPE_ENTRY)
+};
+#undef ACCESS_TYPE_ENTRY
+
+#define FUSED_PAIR_ENTRY(first, firstInstruction, firstMode, second, secondInstruction, secondMode) { first, second,	\
+	&CPU_6502::FusedOp<CPU_6502::Op<CPU_6502::AddressingMode::firstMode, CPU_6502::Operation::firstInstruction>,		\
+		CPU_6502::Op<CPU_6502::AddressingMode::secondMode, CPU_6502::Operation::secondInstruction> >::Run },
+constexpr CPU_6502::FusedPair CPU_6502::fusedPairs[] = {
+	CPU_6502_FUSED_PAIRS(FUSED_PAIR_ENTRY)
+};
+#undef FUSED_PAIR_ENTRY
+
+#define MICRO_OP_ENTRY(code, instruction, mode, cycles) &CPU_6502::MicroOp<CPU_6502::AddressingMode::mode, CPU_6502::Operation::instruction>::Step,
+constexpr CPU_6502::MicroHandler CPU_6502::microOps[0x100] = {
+	CPU_6502_OPCODES(MICRO_OP_ENTRY)
+};
+#undef MICRO_OP_ENTRY
+
+#define MODE_DISASSEMBLER(mode) &CPU_6502::mode##_dis,
+string (CPU_6502::* const CPU_6502::modeDisassemblers[])(uint16_t&) = { CPU_6502_MODES(MODE_DISASSEMBLER) };
+#undef MODE_DISASSEMBLER
+
+CPU_6502::CPU_6502(BusType* bus, ConsoleState* state)
 {
-	if (!bus)
+	if (!bus | !state)
 		throw std::invalid_argument("Invalid NULL argument");
 	this->bus = bus;
+	this->state = state;
+	totalCycles = 0;
+	skippedCycles = 0;
+	recompiler = NULL;
+	threadedCode = NULL;
+	interruptLines = 0;
+	stallCycles = 0;
+	stallAligned = false;
+	nmiLine = false;
+	delayedI = false;
+	MapDirectPages();
+	breakpoints.assign(0x10000, false);
+	breakpointCount = romBreakpoints = 0;
+	stopReason = STOP_NONE;
+	stopAddress = 0;
+	stopData = 0;
+	stopType = Bus::WATCH_READ;
+	resuming = false;
+	runTarget = 0;
+	idleLoop.generation = 0;	// Never a valid generation, so the first loop seen is always checked
+	cycleExact = false;
+	superinstructions = true;
+#ifdef CPU_DECODE_CACHE
+	decodeCache.assign(0x8000, DecodedInstruction());	// Generation 0 marks every entry as not decoded yet
+#endif
+#ifdef CPU_SUPERINSTRUCTIONS
+	for (const FusedPair& pair : fusedPairs)
+	{
+		if (!readOnlyOpCodes[pair.first] || EndsBlock(pair.first))
+			throw std::logic_error("Superinstructions can't start with an instruction that writes memory or jumps");
+	}
+#endif
+	UnpackStatus(0x00);
+#ifdef CPU_OPCODE_PROFILE
+	ResetOpCodeProfile();
+#endif
 
 	Reset();
 }
 
 CPU_6502::~CPU_6502()
 {
+#ifdef CPU_RECOMPILER
+	delete recompiler;
+#endif
+#ifdef CPU_THREADED_CODE
+	delete threadedCode;
+#endif
 }
 
 void CPU_6502::Reset()
@@ -27,853 +120,939 @@ void CPU_6502::Reset()
 	pc = bus->Read(0xFFFC) | (uint16_t)(bus->Read(0xFFFD) << 8);
 	sp = 0xFF;
 	regA = regX = regY = 0x00;
-	currentInterrupt = InterruptType::INTERRUPT_NONE;
+	interruptLines &= INTERRUPT_IRQ_SOURCES | INTERRUPT_DEBUG;		// Devices keep holding IRQ through a reset
+	currentCycle = 0;
+	stallCycles = 0;
+	microOp = NULL;
+	StoreRegisters();
 }
 
-bool CPU_6502::Clock()
+void CPU_6502::OnStateLoaded()
 {
-	static uint8_t currentCycle = 0;
+	currentCycle = 0;		// Anything this CPU was part way through isn't part of the new state
+	microOp = NULL;
+	idleLoop.generation = 0;
+	LoadRegisters();
+}
 
-	if (currentCycle == 0)
+bool CPU_6502::Clock()
+{
+	if (currentCycle != 0)		// Remaining cycles of an instruction the fast core already ran
 	{
-		if (currentInterrupt == INTERRUPT_NONE)
-		{
-			// Fetch next instruction
-			OpCode opCode = opCodes[bus->Read(pc++)];
-			// Determine address using refereced addressing mode
-			bImplied = false;
-			bool extraCycle1 = (this->*opCode.mode)();
-			// Perform the requested opcode instruction
-			bool extraCycle2 = (this->*opCode.instruction)();
-			currentCycle = opCode.cycles - 1;
-			if (extraCycle1 & extraCycle2)
-				currentCycle++;
-		}
-		else
-		{
-			OpCode opCode = { &CPU_6502::INT, &CPU_6502::IMP, 7, "INT", &CPU_6502::IMP_dis };	// Interrupt handling 'instruction'
-			// Set address for proper interrupt handling routine
-			switch (currentInterrupt)
-			{
-			case INTERRUPT_IRQ:
-				address = 0xFFFE;
-				break;
-			case INTERRUPT_NMI:
-				address = 0xFFFA;
-				break;
-			default:
-				throw std::logic_error("Bad interrupt type");
-			}
-			// Handle the interrupt
-			(this->*opCode.instruction)();
-			currentCycle = opCode.cycles - 1;
-			currentInterrupt = INTERRUPT_NONE;
-		}
+		totalCycles++;
+		return --currentCycle == 0;
 	}
-	else
-		{
-			currentCycle--;
-		}
-
-		if (currentCycle == 0)
-			return true;
-		else
+	if (!microOp)
+		stopReason = STOP_NONE;
+	if (cycleExact || microOp)
+	{
+		bool done = MicroStep();
+		if (done && stopReason == STOP_BREAKPOINT)
+			return true;		// Stopped in front of the instruction, the cycle wasn't used
+		totalCycles++;
+		if (!done)
 			return false;
-	return false;
+		if (stallCycles)
+			currentCycle = TakeStall(totalCycles);		// The instruction ends with the halt
+		StoreRegisters();
+		return currentCycle == 0;
+	}
+
+	MarkDirectPages();
+	uint8_t cycles = RunInstruction();
+	if (cycles == 0)
+		return true;		// Stopped at a breakpoint
+	totalCycles++;
+	currentCycle = cycles - 1;
+	if (stallCycles)
+		currentCycle += TakeStall(totalCycles + currentCycle);
+	StoreRegisters();
+	return currentCycle == 0;
 }
 
-void CPU_6502::Step()
+uint32_t CPU_6502::RunCycles(uint32_t budget, uint32_t eventCycles)
 {
-	while (!Clock());	// Keep clocking until instruction is finished
+	uint64_t startCycle = totalCycles;
+	RunUntil(startCycle + budget, startCycle + eventCycles);
+	return (uint32_t)(totalCycles - startCycle);
 }
 
-void CPU_6502::IRQ()
+uint32_t CPU_6502::RunUntil(uint64_t targetCycle, uint64_t eventCycle)
 {
-	if (!status.I)
-		currentInterrupt = INTERRUPT_IRQ;
+	stopReason = STOP_NONE;
+	runTarget = targetCycle;
+	MarkDirectPages();
+
+	// Finish an instruction that was partially clocked through Clock()
+	totalCycles += currentCycle;
+	currentCycle = 0;
+	while (microOp)
+	{
+		MicroStep();
+		totalCycles++;
+	}
+	if (stallCycles)
+		totalCycles += TakeStall(totalCycles);
+
+	while (totalCycles < runTarget)
+	{
+		uint16_t lastPc = pc;		// Address of the last instruction run
+		totalCycles += RunBlock(lastPc);
+		if (stallCycles)
+			totalCycles += TakeStall(totalCycles);		// DMA started by the block's last instruction
+#ifdef CPU_IDLE_SKIP
+		if (pc <= lastPc && lastPc - pc <= IDLE_LOOP_SIZE)
+			CheckIdleLoop(lastPc, runTarget && eventCycle > runTarget ? eventCycle : runTarget);		// Not past a stop
+#endif
+	}
+
+	StoreRegisters();
+	return totalCycles > targetCycle ? (uint32_t)(totalCycles - targetCycle) : 0;
 }
 
-void CPU_6502::NMI()
+uint64_t CPU_6502::GetCycleCount() const
 {
-	currentInterrupt = INTERRUPT_NMI;
+	return totalCycles;
 }
 
-uint8_t CPU_6502::GetA() const
+uint64_t CPU_6502::GetSkippedCycles() const
 {
-	return regA;
+	return skippedCycles;
 }
 
-uint8_t CPU_6502::GetX() const
+void CPU_6502::SetCycleExact(bool exact)
 {
-	return regX;
+	cycleExact = exact;		// An instruction in progress finishes on the core that started it
+	UpdateDebugPolling();
 }
 
-uint8_t CPU_6502::GetY() const
+bool CPU_6502::IsCycleExact() const
 {
-	return regY;
+	return cycleExact;
 }
 
-uint8_t CPU_6502::GetStatus() const
+bool CPU_6502::SetRecompilerMode(RecompilerMode mode)
 {
-	return status.p;
+#ifdef CPU_RECOMPILER
+	delete recompiler;
+	recompiler = NULL;
+	if (mode == RECOMPILER_OFF)
+		return true;
+	try
+	{
+		recompiler = new Recompiler(*this, mode == RECOMPILER_CHECKED);
+	}
+	catch (const runtime_error&)		// No executable memory, the host won't let us map any
+	{
+		return false;
+	}
+	return true;
+#else
+	return mode == RECOMPILER_OFF;
+#endif
 }
 
-uint16_t CPU_6502::GetProgramCounter() const
+bool CPU_6502::SetThreadedCode(bool enabled)
 {
-	return pc;
+#ifdef CPU_THREADED_CODE
+	delete threadedCode;
+	threadedCode = enabled ? new ThreadedCode(*this) : NULL;
+	return true;
+#else
+	return !enabled;
+#endif
 }
 
-uint8_t CPU_6502::GetStackPointer() const
+bool CPU_6502::SetSuperinstructions(bool enabled)
 {
-	return sp;
+#ifdef CPU_SUPERINSTRUCTIONS
+	superinstructions = enabled;
+	decodeCache.assign(0x8000, DecodedInstruction());		// Decoded again with or without pairs
+	return true;
+#else
+	return !enabled;
+#endif
 }
 
-const std::vector<CPU_6502::DisassembledInstruction>* CPU_6502::Disassemble(uint16_t startAddress, uint16_t size)
+uint32_t CPU_6502::RunBlock(uint16_t& lastInstruction)
 {
-	disassembleInfo.clear();
-	instructionMap.clear();
-	CPU_6502::OpCode instruction;
-	CPU_6502::DisassembledInstruction instructionInfo;
-	int index = 0;
+	// Blocks, threads and pairs are instruction level, so they are only used by the fast core,
+	// and they don't poll for interrupts, so anything on the interrupt lines goes to RunInstruction
+	if (cycleExact || interruptLines)
+		return RunInstruction();
 
-	uint16_t counter = startAddress;
-	while (counter < startAddress + size)
+#ifdef CPU_RECOMPILER
+	if (recompiler)
 	{
-		instructionMap.emplace(counter, index);
-		instructionInfo.address = counter;
-		instruction = opCodes[bus->Read(counter++)];
-		instructionInfo.instructionString = std::string(instruction.opCode) + " " + (this->*instruction.mode_dis)(counter);
-		instructionInfo.instructionSize = counter - instructionInfo.address;
-		disassembleInfo.push_back(instructionInfo);
+		uint32_t cycles = recompiler->Run(lastInstruction);
+		if (cycles)
+			return cycles;
 	}
-
-	return &disassembleInfo;
+#endif
+#ifdef CPU_THREADED_CODE
+	if (threadedCode)
+	{
+		uint32_t cycles = threadedCode->Run(lastInstruction);
+		if (cycles)
+			return cycles;
+	}
+#endif
+#ifdef CPU_SUPERINSTRUCTIONS
+	// Pairs only run from here, so single instruction callers (Clock, Step) never see half of one
+	if (pc & 0x8000)
+	{
+		DecodedInstruction& instruction = decodeCache[pc & 0x7FFF];
+		if (instruction.generation != bus->GetGeneration(pc))
+			Decode(instruction, pc);
+		if (instruction.fused)
+		{
+			lastInstruction = pc + instruction.size;
+			pc += instruction.fusedSize;
+			return instruction.fusedCycles + instruction.fused(*this, instruction.operand, instruction.nextOperand);
+		}
+		if (instruction.run)
+		{
+			pc += instruction.size;		// Already decoded, don't look it up again in RunInstruction
+			return instruction.cycles + instruction.run(*this, instruction.operand);
+		}
+	}
+#endif
+	return RunInstruction();
 }
 
-// ****************
-// Addressing Modes
-// ****************
-bool CPU_6502::ZPX()		// Zero Page Indexed (X)
-{
-	uint8_t base = bus->Read(pc++);
-	address = (base + regX) && 0x00FF;
-	return false;
-}
-string CPU_6502::ZPX_dis(uint16_t& counter)
-{
-	uint8_t base = bus->Read(counter++);
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(2) << hex << base;
-	return string("$" + ss.str() + ",X");
-}
-bool CPU_6502::ZPY()		// Zero Page Indexed (Y)
-{
-	uint8_t base = bus->Read(pc++);
-	address = (base + regY) && 0x00FF;
-	//stringstream ss;
-	//ss << uppercase << setfill('0') << setw(2) << hex << base;
-	//operandString = "$" + ss.str() + ",Y";
-	return false;
-}
-string CPU_6502::ZPY_dis(uint16_t& counter)
-{
-	uint8_t base = bus->Read(counter++);
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(2) << hex << base;
-	return string("$" + ss.str() + ",Y");
-}
-bool CPU_6502::ABX()		// Absolute Indexed (X)
-{
-	uint8_t lsb = bus->Read(pc++);
-	uint16_t msb = (uint16_t)bus->Read(pc++);
-	address = (lsb + regX) | (msb << 8);
-	if ((address & 0x00FF) < regX)
-		return true;
-	return false;
-}
-string CPU_6502::ABX_dis(uint16_t& counter)
-{
-	uint8_t lsb = bus->Read(counter++);
-	uint16_t msb = (uint16_t)bus->Read(counter++);
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(4) << hex << (lsb | (msb << 8));
-	return string("$" + ss.str() + ",X");
-}
-bool CPU_6502::ABY()		// Absolute Indexed (Y)
-{
-	uint8_t lsb = bus->Read(pc++);
-	uint16_t msb = (uint16_t)bus->Read(pc++);
-	address = (lsb + regY) | (msb << 8);
-	if ((address & 0x00FF) < regY)
-		return true;
-	return false;
-}
-string CPU_6502::ABY_dis(uint16_t& counter)
-{
-	uint8_t lsb = bus->Read(counter++);
-	uint16_t msb = (uint16_t)bus->Read(counter++);
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(4) << hex << (lsb | (msb << 8));
-	return string("$" + ss.str() + ",Y");
-}
-bool CPU_6502::IZX()		// Indexed Indirect
-{
-	uint8_t pointer = bus->Read(pc++);
-	address = (bus->Read(pointer++ + regX) & 0x00FF) | (uint16_t)(bus->Read(pointer-- + regX) & 0x00FFF) << 8;
-	return false;
-}
-string CPU_6502::IZX_dis(uint16_t& counter)
+uint8_t CPU_6502::RunInstruction()
 {
-	uint8_t pointer = bus->Read(counter++);
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(2) << hex << (int)pointer;
-	return string("($" + ss.str() + ",X)");
-}
-bool CPU_6502::IZY()		// Indirect Indexed
-{
-	uint8_t pointer = bus->Read(pc++);
-	address = (bus->Read(pointer++) | (uint16_t)(bus->Read(pointer--) & 0x00FF) << 8) + regY;
-	if ((address & 0x00FF) < regY)
-		return true;
-	return false;
-}
-string CPU_6502::IZY_dis(uint16_t& counter)
-{
-	uint8_t pointer = bus->Read(counter++);
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(2) << hex << (int)pointer;
-	return string("($" + ss.str() + "),Y");
-}
-bool CPU_6502::IMP()		// Implicit
-{
-	bImplied = true;
-	return false;
-}
-string CPU_6502::IMP_dis(uint16_t& counter)
-{
-	return string("");
-}
-bool CPU_6502::IMM()		// Immediate
-{
-	address = pc++;
-	return false;
-}
-string CPU_6502::IMM_dis(uint16_t& counter)
-{
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(2) << hex << (int)bus->Read(counter++);
-	return string("#$" + ss.str());
-}
-bool CPU_6502::ZP()			// Zero Page
-{
-	address = bus->Read(pc++);
-	return false;
-}
-string CPU_6502::ZP_dis(uint16_t& counter)
-{
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(2) << hex << bus->Read(counter++);
-	return string("$" + ss.str());
-}
-bool CPU_6502::ABS()		// Absolute
-{
-	address = bus->Read(pc++) | (uint16_t)(bus->Read(pc++) << 8);
-	return false;
-}
-string CPU_6502::ABS_dis(uint16_t& counter)
-{
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(4) << hex << (bus->Read(counter++) | (uint16_t)(bus->Read(counter++) << 8));
-	return string("$" + ss.str());
-}
-bool CPU_6502::REL()		// Relative
-{
-	uint8_t offset = bus->Read(pc++);
-	if (offset & 0x80)
+	if (cycleExact)
 	{
-		// Offset is negative, subtract 2's compliment from pc
-		offset ^= 0xFF;
-		offset++;
-		address = pc - offset;
-		if ((address & 0x00FF) > offset)
-			return true;
-	} 
-	else
+		// Run the whole instruction on the micro-op core
+		uint8_t cycles = 1;
+		while (!MicroStep())
+			cycles++;
+		return stopReason == STOP_BREAKPOINT ? 0 : cycles;		// A stop only ends the run, see StopAtBreakpoint
+	}
+
+	InterruptType interrupt = interruptLines ? PollInterrupts() : INTERRUPT_NONE;
+	if (interrupt == INTERRUPT_NONE)
 	{
-		address = pc + offset;
-		if ((address & 0x00FF) < offset)
-			return true;
+#ifdef CPU_DECODE_CACHE
+		if (pc & 0x8000)
+		{
+			// PRG-ROM: skip fetch and decode unless the block changed since the instruction was last decoded
+			DecodedInstruction& instruction = decodeCache[pc & 0x7FFF];
+			if (instruction.generation != bus->GetGeneration(pc))
+				Decode(instruction, pc);
+			if (instruction.run)
+			{
+				pc += instruction.size;
+				return PROFILE_OPCODE(instruction.opCode, instruction.cycles + instruction.run(*this, instruction.operand));
+			}
+		}
+#endif
+#ifdef CPU_FUSED_DISPATCH
+		// Fetch and execute next instruction in a single fused handler
+		uint8_t opCode = bus->Fetch(pc++);
+		return PROFILE_OPCODE(opCode, Execute(opCode));
+#else
+		// Fetch next instruction and run its handler
+		uint8_t code = bus->Fetch(pc++);
+		const OpCode& opCode = opCodes[code];
+		return PROFILE_OPCODE(code, opCode.cycles + opCode.handler(*this));
+#endif
 	}
-	return false;
-}
-string CPU_6502::REL_dis(uint16_t& counter)
-{
-	uint8_t offset = bus->Read(counter++);
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(2) << hex << (uint16_t)offset;
-	return string("$" + ss.str());
-}
-bool CPU_6502::IND()		// Indirect
-{
-	uint16_t pointer = bus->Read(pc++) | (uint16_t)(bus->Read(pc++) << 8);
-	address = bus->Read(pointer++) | (uint16_t)(bus->Read(pointer) << 8);
-	return false;
-}
 
-string CPU_6502::IND_dis(uint16_t& counter)
-{
-	uint16_t pointer = bus->Read(counter++) | (uint16_t)(bus->Read(counter++) << 8);
-	stringstream ss;
-	ss << uppercase << setfill('0') << setw(4) << hex << pointer;
-	return string("($" + ss.str() + ")");
+	// Handle the interrupt using the proper interrupt handling routine
+	switch (interrupt)
+	{
+	case INTERRUPT_IRQ:
+		INT(0xFFFE);
+		break;
+	case INTERRUPT_NMI:
+		INT(0xFFFA);
+		break;
+	case INTERRUPT_BREAK:
+		return 0;		// Stopped, nothing ran
+	default:
+		throw std::logic_error("Bad interrupt type");
+	}
+	return INTERRUPT_CYCLES;
 }
 
+void CPU_6502::Decode(DecodedInstruction& instruction, uint16_t address)
+{
+	uint8_t code;
+	uint16_t operand;
+	bool whole = FetchCached(address, address, code, operand);
+	const OpCode& opCode = opCodes[code];
+	instruction.generation = bus->TrackGeneration(address);
+	instruction.size = 1 + opCode.size;
+	instruction.cycles = opCode.cycles;
+	instruction.opCode = code;
+	instruction.fused = NULL;
 
-// ************
-// Instructions
-// ************
+	if (breakpoints[address])
+	{
+		// Stand in for the instruction without moving pc (see Breakpoint)
+		instruction.run = &Breakpoint;
+		instruction.size = 0;
+		instruction.cycles = 0;
+		return;
+	}
 
-// Logical and Arithmetic Commands
-bool CPU_6502::ORA()
-{
-	regA |= bus->Read(address);
-	SetZ(regA == 0);
-	SetN(regA & 0x80);
-	return true;
-}
-bool CPU_6502::AND()
-{
-	regA &= bus->Read(address);
-	SetZ(regA == 0);
-	SetN(regA & 0x80);
-	return true;
-}
-bool CPU_6502::EOR()
-{
-	regA ^= bus->Read(address);
-	SetZ(regA == 0);
-	SetN(regA & 0x80);
-	return true;
-}
-bool CPU_6502::ADC()
-{
-	AddCarry(bus->Read(address));
-	return true;
+	// The entry is only checked against the block it starts in, so leave instructions that
+	// run into the next block to the normal fetch
+	if (!whole)
+	{
+		instruction.run = NULL;
+		return;
+	}
+
+	instruction.run = opCode.run;
+	instruction.operand = operand;
+#ifdef CPU_SUPERINSTRUCTIONS
+	if (superinstructions)
+		DecodeFused(instruction, code, address);
+#endif
 }
-bool CPU_6502::SBC()
-{
-	AddCarry(bus->Read(address) ^ 0xFF + 1);		// Subtract is the same as add negative
-	return true;
+
+void CPU_6502::DecodeFused(DecodedInstruction& instruction, uint8_t opCode, uint16_t address)
+{
+	const FusedPair* pair = fusedPairs;
+	const FusedPair* end = fusedPairs + sizeof(fusedPairs) / sizeof(fusedPairs[0]);
+	while (pair != end && pair->first != opCode)
+		pair++;
+	if (pair == end)
+		return;
+
+	// Both halves have to be in the block the generation was taken from, and the pair would run
+	// straight through a breakpoint on the second
+	uint16_t next = address + instruction.size;
+	uint8_t nextOpCode;
+	uint16_t nextOperand;
+	if (!FetchCached(next, address, nextOpCode, nextOperand))
+		return;
+	while (pair != end && (pair->first != opCode || pair->second != nextOpCode))
+		pair++;
+	if (pair == end)
+		return;
+
+	const OpCode& second = opCodes[nextOpCode];
+	instruction.fused = pair->run;
+	instruction.fusedSize = instruction.size + 1 + second.size;
+	instruction.fusedCycles = instruction.cycles + second.cycles;
+	instruction.nextOperand = nextOperand;
 }
-bool CPU_6502::CMP()
-{
-	Compare(regA, bus->Read(address));
+
+bool CPU_6502::FetchCached(uint16_t address, uint16_t start, uint8_t& opCode, uint16_t& operand) const
+{
+	// Decode cache entries, recompiled blocks and threads are only checked against the generation of the 4K
+	// block they start in, so they stop at an instruction that runs into the next block, and at a breakpoint.
+	// An instruction on a page with a read watchpoint is left to the normal fetch too, so the watchpoint sees
+	// its opcode and operand reads. Returns false for any of these, opCode is peeked anyway.
+	opCode = bus->Peek(address);
+	operand = 0;
+	const OpCode& info = opCodes[opCode];
+	if (breakpoints[address] || ((address + info.size) & 0xF000) != (start & 0xF000))
+		return false;
+	if ((bus->GetWatchTypes(address) | bus->GetWatchTypes(address + info.size)) & Bus::WATCH_READ)
+		return false;
+
+	if (info.size > 0)
+		operand = bus->Peek(address + 1);
+	if (info.size > 1)
+		operand |= (uint16_t)(bus->Peek(address + 2) << 8);
 	return true;
 }
-bool CPU_6502::CPX()
-{
-	Compare(regX, bus->Read(address));
-	return false;
-}
-bool CPU_6502::CPY()
-{
-	Compare(regY, bus->Read(address));
-	return false;
-}
-bool CPU_6502::DEC()
-{
-	bus->Write(address, Decrement(bus->Read(address)));
-	return false;
-}
-bool CPU_6502::DEX()
-{
-	regX = Decrement(regX);
-	return false;
-}
-bool CPU_6502::DEY()
-{
-	regY = Decrement(regY);
-	return false;
-}
-bool CPU_6502::INC()
-{
-	bus->Write(address, Decrement(bus->Read(address)));
-	return false;
-}
-bool CPU_6502::INX()
-{
-	regX = Increment(regX);
-	return false;
-}
-bool CPU_6502::INY()
-{
-	regY = Increment(regY);
-	return false;
-}
-bool CPU_6502::ASL()
+
+void CPU_6502::CheckIdleLoop(uint16_t branch, uint64_t targetCycle)
 {
-	if (!bImplied)
+	uint8_t p = PackStatus();
+	if (branch != idleLoop.branch || pc != idleLoop.target || bus->GetGeneration(branch) != idleLoop.generation)
 	{
-		uint8_t data = bus->Read(address);
-		SetC(data & 0x80);
-		data = data << 1;
-		bus->Write(address, data);
-		SetN(data & 0x80);
-		SetZ(data == 0);
+		// New loop, find out if its body could change anything besides the registers
+		idleLoop.branch = branch;
+		idleLoop.target = pc;
+		idleLoop.generation = bus->TrackGeneration(branch);
+		idleLoop.readOnly = IsReadOnlyLoop(pc, branch);
 	}
-	else
+	else if (idleLoop.readOnly && !interruptLines && !breakpointCount && totalCycles < targetCycle &&
+		regA == idleLoop.a && regX == idleLoop.x && regY == idleLoop.y && sp == idleLoop.sp && p == idleLoop.p)
 	{
-		SetC(regA & 0x80);
-		regA = regA << 1;
-		SetN(regA & 0x80);
-		SetZ(regA == 0);
+		// One whole iteration left every register as it was, so the loop will keep doing the same thing
+		// until something outside the cpu changes memory. Skip the iterations that fit before the target.
+		uint64_t iterationCycles = totalCycles - idleLoop.cycle;
+		uint64_t skip = (targetCycle - totalCycles) / iterationCycles * iterationCycles;
+		totalCycles += skip;
+		skippedCycles += skip;
 	}
-	return false;
+
+	idleLoop.a = regA;
+	idleLoop.x = regX;
+	idleLoop.y = regY;
+	idleLoop.sp = sp;
+	idleLoop.p = p;
+	idleLoop.cycle = totalCycles;
 }
-bool CPU_6502::ROL()
+
+bool CPU_6502::IsReadOnlyLoop(uint16_t start, uint16_t branch) const
 {
-	if (!bImplied)
+	// Straight line of read-only instructions ending in the branch back to the start
+	uint16_t address = start;
+	while (address != branch)
 	{
-		uint8_t data = bus->Read(address);
-		uint8_t c = status.C;
-		SetC(data & 0x80);
-		data = (data << 1) | c;
-		bus->Write(address, data);
-		SetN(data & 0x80);
-		SetZ(data == 0);
-	}
-	else
-	{
-		uint8_t c = status.C;
-		SetC(regA & 0x80);
-		regA = (regA << 1) | c;
-		SetN(regA & 0x80);
-		SetZ(regA == 0);
+		uint8_t opCode = bus->Peek(address);
+		if (!readOnlyOpCodes[opCode])
+			return false;
+		address += 1 + opCodes[opCode].size;
+		if ((uint16_t)(address - start) > (uint16_t)(branch - start))
+			return false;		// Instructions don't line up with the branch
 	}
-	return false;
+	uint8_t closing = bus->Peek(branch);
+	return opCodeInfo[closing].mode == MODE_REL || closing == 0x4C;		// Branch or absolute JMP
 }
-bool CPU_6502::LSR()
+
+bool CPU_6502::EndsBlock(uint8_t opCode)
 {
-	if (!bImplied)
-	{
-		uint8_t data = bus->Read(address);
-		SetC(data & 0x01);
-		data = data >> 1;
-		bus->Write(address, data);
-		SetN(data & 0x80);
-		SetZ(data == 0);
-	}
-	else
+	switch (opCode)
 	{
-		SetC(regA & 0x01);
-		regA = regA >> 1;
-		SetN(regA & 0x80);
-		SetZ(regA == 0);
+	case 0x00:	// BRK
+	case 0x20:	// JSR
+	case 0x40:	// RTI
+	case 0x4C:	// JMP
+	case 0x60:	// RTS
+	case 0x6C:	// JMP (indirect)
+		return true;
 	}
-	return false;
+	return opCodeInfo[opCode].mode == MODE_REL;
 }
-bool CPU_6502::ROR()
+
+bool CPU_6502::MicroStep()
 {
-	if (!bImplied)
+	if (!microOp)
 	{
-		uint8_t data = bus->Read(address);
-		uint8_t c = status.C << 7;
-		SetC(data & 0x01);
-		data = (data >> 1) | c;
-		bus->Write(address, data);
-		SetN(data & 0x80);
-		SetZ(data == 0);
+		// First cycle: fetch the opcode, or start the interrupt sequence in its place
+		InterruptType interrupt = interruptLines ? PollInterrupts() : INTERRUPT_NONE;
+		if (interrupt == INTERRUPT_BREAK)
+			return true;		// Stopped, nothing was started
+		if (interrupt == INTERRUPT_NONE)
+		{
+			uint8_t opCode = bus->Fetch(pc++);
+			microOp = microOps[opCode];
+#ifdef CPU_OPCODE_PROFILE
+			microOpCode = opCode;
+#endif
+		}
+		else
+		{
+#ifdef CPU_OPCODE_PROFILE
+			microOpCode = 0x100;
+#endif
+			bus->Read(pc);
+			switch (interrupt)
+			{
+			case INTERRUPT_IRQ:
+				microAddress = 0xFFFE;
+				break;
+			case INTERRUPT_NMI:
+				microAddress = 0xFFFA;
+				break;
+			default:
+				throw std::logic_error("Bad interrupt type");
+			}
+			status.B = 0x10;
+			microOp = &MicroInterrupt::Step;
+		}
+		microStep = 2;
+		return false;
 	}
-	else
+
+	if (microOp(*this))
 	{
-		uint8_t c = status.C << 7;
-		SetC(regA & 0x01);
-		regA = (regA >> 1) | c;
-		SetN(regA & 0x80);
-		SetZ(regA == 0);
+#ifdef CPU_OPCODE_PROFILE
+		if (microOpCode < 0x100)
+			CountOpCode((uint8_t)microOpCode, microStep);
+#endif
+		microOp = NULL;
+		return true;
 	}
+	microStep++;
 	return false;
 }
 
-// Move Commands
-bool CPU_6502::LDA()
-{
-	regA = bus->Read(address);
-	SetN(regA & 0x80);
-	SetZ(regA == 0);
-	return true;
-}
-bool CPU_6502::STA()
-{
-		bus->Write(address, regA);
-	return false;
-}
-bool CPU_6502::LDX()
-{
-	regX = bus->Read(address);
-	SetN(regX & 0x80);
-	SetZ(regX == 0);
-	return true;
-}
-bool CPU_6502::STX()
-{
-	bus->Write(address, regX);
-	return false;
-}
-bool CPU_6502::LDY()
-{
-	regY = bus->Read(address);
-	SetN(regY & 0x80);
-	SetZ(regY == 0);
-	return true;
-}
-bool CPU_6502::STY()
-{
-	bus->Write(address, regY);
-	return false;
-}
-bool CPU_6502::TAX()
-{
-	regX = regA;
-	SetN(regX & 0x80);
-	SetZ(regX == 0);
-	return false;
-}
-bool CPU_6502::TXA()
-{
-	regA = regX;
-	SetN(regA & 0x80);
-	SetZ(regA == 0);
-	return false;
-}
-bool CPU_6502::TAY()
-{
-	regY = regA;
-	SetN(regY & 0x80);
-	SetZ(regY == 0);
-	return false;
-}
-bool CPU_6502::TYA()
+void CPU_6502::Step()
 {
-	regA = regY;
-	SetN(regA & 0x80);
-	SetZ(regA == 0);
-	return false;
+	while (!Clock());	// Keep clocking until instruction is finished
 }
-bool CPU_6502::TSX()
+
+void CPU_6502::SetIRQ(IRQSource source, bool asserted)
 {
-	regX = sp;
-	SetN(regX & 0x80);
-	SetZ(regX == 0);
-	return false;
+	if (asserted)
+		interruptLines |= source;
+	else
+		interruptLines &= ~source;
+	StoreInterrupts();
 }
-bool CPU_6502::TXS()
+
+void CPU_6502::SetNMI(bool asserted)
 {
-	sp = regX;
-	return false;
+	if (asserted && !nmiLine)
+		interruptLines |= INTERRUPT_NMI_LATCHED;
+	nmiLine = asserted;
+	StoreInterrupts();
 }
-bool CPU_6502::PLA()
+
+void CPU_6502::IRQ()
 {
-	regA = bus->Read(++sp | 0x0100);
-	SetN(regA & 0x80);
-	SetZ(regA == 0);
-	return false;
+	SetIRQ(IRQ_EXTERNAL, true);
 }
-bool CPU_6502::PHA()
+
+void CPU_6502::NMI()
 {
-	bus->Write(sp-- | 0x0100, regA);
-	return false;
+	SetNMI(true);
+	SetNMI(false);
 }
-bool CPU_6502::PLP()
+
+void CPU_6502::Stall(uint16_t cycles, bool evenAligned)
 {
-	status.p = bus->Read(++sp | 0x0100);
-	return false;
+	stallCycles += cycles;
+	stallAligned |= evenAligned;
+	StoreInterrupts();
 }
-bool CPU_6502::PHP()
+
+uint16_t CPU_6502::TakeStall(uint64_t cycle)
 {
-	status.B = 0x11;
-	bus->Write(sp-- | 0x0100, status.p);
-	return false;
+	uint16_t cycles = stallCycles + (stallAligned && (cycle & 1) ? 1 : 0);
+	stallCycles = 0;
+	stallAligned = false;
+	return cycles;
 }
 
-// Jump/Flag Commands
-bool CPU_6502::BPL()
+CPU_6502::InterruptType CPU_6502::PollInterrupts()
 {
-	if (!status.N)
-		pc = address;
-	return true;
+	uint16_t delayed = interruptLines & INTERRUPT_I_DELAYED;
+	bool masked = delayed ? delayedI : status.I;
+	interruptLines &= ~INTERRUPT_I_DELAYED;
+	if (interruptLines & INTERRUPT_NMI_LATCHED)
+	{
+		interruptLines &= ~INTERRUPT_NMI_LATCHED;
+		return INTERRUPT_NMI;		// NMI wins over IRQ, which is still there at the next poll
+	}
+	if ((interruptLines & INTERRUPT_IRQ_SOURCES) && !masked)
+		return INTERRUPT_IRQ;
+#ifdef CPU_DECODE_CACHE
+	bool trapped = (pc & 0x8000) && !cycleExact;		// Left to the decode cache entry
+#else
+	bool trapped = false;
+#endif
+	if ((interruptLines & INTERRUPT_DEBUG) && breakpoints[pc] && !trapped && StopAtBreakpoint())
+	{
+		interruptLines |= delayed;		// This poll didn't count, the instruction hasn't run
+		return INTERRUPT_BREAK;
+	}
+	return INTERRUPT_NONE;
 }
-bool CPU_6502::BMI()
+
+void CPU_6502::SetBreakpoint(uint16_t address, bool enabled)
 {
-	if (status.N)
-		pc = address;
-	return true;
+	if (breakpoints[address] == enabled)
+		return;
+
+	breakpoints[address] = enabled;
+	breakpointCount += enabled ? 1 : -1;
+	if (address & 0x8000)
+		romBreakpoints += enabled ? 1 : -1;
+	bus->Invalidate(address);		// Rebuilds the decode cache entries, blocks and threads around it
+	UpdateDebugPolling();
 }
-bool CPU_6502::BVC()
+
+void CPU_6502::SetWatchpoint(uint16_t address, uint8_t types)
 {
-	if (!status.V)
-		pc = address;
-	return true;
+	if (types)
+		watchpoints[address] = types;
+	else
+		watchpoints.erase(address);
+	bus->SetWatcher(this);
+	bus->SetWatchpoint(address, types);
+	bus->Invalidate(address);		// Instructions cached from the page are fetched through the bus again, or cached again
+	MapDirectPages();
+	UpdateDebugPolling();
 }
-bool CPU_6502::BVS()
+
+CPU_6502::StopReason CPU_6502::GetStopReason() const
 {
-	if (status.V)
-		pc = address;
-	return true;
+	return stopReason;
 }
-bool CPU_6502::BCC()
+
+uint16_t CPU_6502::GetStopAddress() const
 {
-	if (!status.C)
-		pc = address;
-	return true;
+	return stopAddress;
 }
-bool CPU_6502::BCS()
+
+uint8_t CPU_6502::GetStopData() const
 {
-	if (status.C)
-		pc = address;
-	return true;
+	return stopData;
 }
-bool CPU_6502::BNE()
+
+Bus::WatchType CPU_6502::GetStopType() const
 {
-	if (!status.Z)
-		pc = address;
-	return true;
+	return stopType;
 }
-bool CPU_6502::BEQ()
+
+bool CPU_6502::StopAtBreakpoint()
 {
-	if (status.Z)
-		pc = address;
+	// Running again after a stop lets the instruction at the breakpoint through once
+	bool resume = resuming && pc == stopAddress;
+	resuming = false;
+	if (resume)
+		return false;
+
+	stopReason = STOP_BREAKPOINT;
+	stopAddress = pc;
+	resuming = true;
+	runTarget = 0;			// Ends RunUntil
 	return true;
 }
-bool CPU_6502::BRK()
-{
-	status.B = 0x11;
-	bus->Write(sp-- | 0x0100, (pc & 0xFF00) >> 8);
-	bus->Write(sp-- | 0x0100, pc & 0x00FF);
-	bus->Write(sp-- | 0x0100, status.p);
-	pc = bus->Read(0xFFFE) | (bus->Read(0xFFFF) << 8);
-	status.I = 1;
-	return false;
-}
-bool CPU_6502::INT()
-{
-	status.B = 0x10;
-	bus->Write(sp-- | 0x0100, (pc & 0xFF00) >> 8);
-	bus->Write(sp-- | 0x0100, pc & 0x00FF);
-	bus->Write(sp-- | 0x0100, status.p);
-	pc = bus->Read(address) | (bus->Read(address + 1) << 8);
-	status.I = 1;
-	return false;
-}
-bool CPU_6502::RTI()
-{
-	status.p = bus->Read(++sp | 0x0100);
-	pc = bus->Read(++sp | 0x0100) | (bus->Read(++sp | 0x0100) << 8);
-	return false;
-}
-bool CPU_6502::JSR()
-{
-	bus->Write(sp-- | 0x0100, (pc & 0xFF00) >> 8);
-	bus->Write(sp-- | 0x0100, pc & 0x00FF);
-	pc = address;
-	return false;
-}
-bool CPU_6502::RTS()
-{
-	pc = bus->Read(++sp | 0x0100) | (bus->Read(++sp | 0x0100) << 8);
-	return false;
-}
-bool CPU_6502::JMP()
+
+uint8_t CPU_6502::Breakpoint(CPU_6502& cpu, uint16_t operand)
 {
-	pc = address;
-	return false;
+	if (cpu.StopAtBreakpoint())
+		return 0;
+
+	// Resuming, run the instruction the entry stands in for
+	uint8_t code = cpu.bus->Fetch(cpu.pc++);
+	const OpCode& opCode = opCodes[code];
+	return opCode.cycles + opCode.handler(cpu);
 }
-bool CPU_6502::BIT()
+
+void CPU_6502::OnWatch(uint16_t address, uint8_t data, Bus::WatchType type)
 {
-	SetN(bus->Read(address) & 0x80);
-	SetV(bus->Read(address) & 0x40);
-	SetZ(bus->Read(address) & regA);
-	return false;
+	stopReason = STOP_WATCHPOINT;
+	stopAddress = address;
+	stopData = data;
+	stopType = type;
+	runTarget = 0;			// INTERRUPT_DEBUG runs one instruction at a time, so RunUntil ends after this one
 }
-bool CPU_6502::CLC()
-{
-	SetC(0);
-	return false;
+
+void CPU_6502::UpdateDebugPolling()
+{
+	uint32_t polled = breakpointCount;
+#ifdef CPU_DECODE_CACHE
+	if (!cycleExact)
+		polled -= romBreakpoints;
+#endif
+	if (polled || !watchpoints.empty())
+		interruptLines |= INTERRUPT_DEBUG;
+	else
+		interruptLines &= ~INTERRUPT_DEBUG;
 }
-bool CPU_6502::SEC()
-{
-	SetC(1);
-	return false;
+
+void CPU_6502::LoadRegisters()
+{
+	const ConsoleState::CPUState& registers = state->cpu;
+	totalCycles = registers.cycles;
+	pc = registers.pc;
+	regA = registers.a;
+	regX = registers.x;
+	regY = registers.y;
+	sp = registers.sp;
+	UnpackStatus(registers.p);
+	interruptLines = (registers.interruptLines & ~INTERRUPT_DEBUG) | (interruptLines & INTERRUPT_DEBUG);	// Debugging stays with this CPU
+	stallCycles = registers.stallCycles;
+	stallAligned = registers.stallAligned;
+	nmiLine = registers.nmiLine;
+	delayedI = registers.delayedI;
 }
-bool CPU_6502::CLD()
-{
-	SetD(0);
-	return false;
+
+void CPU_6502::StoreRegisters()
+{
+	ConsoleState::CPUState& registers = state->cpu;
+	registers.cycles = totalCycles + currentCycle;		// The fast core has already run the rest of the instruction
+	registers.pc = pc;
+	registers.a = regA;
+	registers.x = regX;
+	registers.y = regY;
+	registers.sp = sp;
+	registers.p = PackStatus();
+	StoreInterrupts();
 }
-bool CPU_6502::SED()
+
+void CPU_6502::StoreInterrupts()
 {
-	SetD(1);
-	return false;
+	ConsoleState::CPUState& registers = state->cpu;
+	registers.interruptLines = interruptLines & ~INTERRUPT_DEBUG;
+	registers.stallCycles = stallCycles;
+	registers.stallAligned = stallAligned;
+	registers.nmiLine = nmiLine;
+	registers.delayedI = delayedI;
 }
-bool CPU_6502::CLI()
+
+void CPU_6502::MapDirectPages()
 {
-	SetI(0);
-	return false;
+	zeroPage = stackPage = NULL;
+#ifdef CPU_DIRECT_RAM
+	if (bus->GetWritePage(0x0000) && bus->GetReadPage(0x0000) == bus->GetWritePage(0x0000))
+		zeroPage = bus->GetWritePage(0x0000);
+	if (bus->GetWritePage(0x0100) && bus->GetReadPage(0x0100) == bus->GetWritePage(0x0100))
+		stackPage = bus->GetWritePage(0x0100);
+#endif
 }
-bool CPU_6502::SEI()
+
+uint8_t CPU_6502::GetA() const
 {
-	SetI(1);
-	return false;
+	return regA;
 }
-bool CPU_6502::CLV()
+
+uint8_t CPU_6502::GetX() const
 {
-	SetV(0);
-	return false;
+	return regX;
 }
-bool CPU_6502::NOP()
+
+uint8_t CPU_6502::GetY() const
 {
-	return false;
+	return regY;
 }
 
-// Illegal Opcodes
-bool CPU_6502::SLO()
+uint8_t CPU_6502::GetStatus() const
 {
-	return false;
+	return PackStatus();
 }
-bool CPU_6502::RLA()
+
+uint16_t CPU_6502::GetProgramCounter() const
 {
-	return false;
+	return pc;
 }
-bool CPU_6502::SRE()
+
+uint8_t CPU_6502::GetStackPointer() const
 {
-	return false;
+	return sp;
 }
-bool CPU_6502::RRA()
+
+const std::vector<CPU_6502::DisassembledInstruction>* CPU_6502::Disassemble(uint16_t startAddress, uint16_t size)
 {
-	return false;
+	disassembleInfo.clear();
+	instructionMap.clear();
+	CPU_6502::DisassembledInstruction instructionInfo;
+	int index = 0;
+
+	// Peek the whole range up front, with room for the operands of the last instruction
+	disassembleStart = startAddress;
+	disassembleBytes.resize(size + 3);
+	bus->PeekBlock(startAddress, disassembleBytes.data(), size + 3);
+
+	uint16_t counter = startAddress;
+	while (counter < startAddress + size)
+	{
+		instructionMap.emplace(counter, index);
+		instructionInfo.address = counter;
+		const OpCodeInfo& instruction = opCodeInfo[DisassembledByte(counter++)];
+		instructionInfo.instructionString = std::string(instruction.opCode) + " " + (this->*modeDisassemblers[instruction.mode])(counter);
+		instructionInfo.instructionSize = counter - instructionInfo.address;
+		disassembleInfo.push_back(instructionInfo);
+	}
+
+	return &disassembleInfo;
 }
-bool CPU_6502::SAX()
+
+uint8_t CPU_6502::Execute(uint8_t opCode)
 {
-	return false;
+	// One case per opcode with the handler template called directly,
+	// so the compiler is free to inline it into the switch
+	switch (opCode)
+	{
+#define OPCODE_CASE(code, instruction, mode, cycles)	\
+	case code:											\
+		return cycles + Op<AddressingMode::mode, Operation::instruction>::Execute(*this);
+
+		CPU_6502_OPCODES(OPCODE_CASE)
+#undef OPCODE_CASE
+	}
+	return 0;
 }
-bool CPU_6502::LAX()
+
+// ***********
+// Disassembly
+// ***********
+uint8_t CPU_6502::DisassembledByte(uint16_t address) const
 {
-	return false;
+	return disassembleBytes[(uint16_t)(address - disassembleStart)];
 }
-bool CPU_6502::DCP()
+string CPU_6502::ZPX_dis(uint16_t& counter)
 {
-	return false;
+	uint8_t base = DisassembledByte(counter++);
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(2) << hex << base;
+	return string("$" + ss.str() + ",X");
 }
-bool CPU_6502::ISC()
+string CPU_6502::ZPY_dis(uint16_t& counter)
 {
-	return false;
+	uint8_t base = DisassembledByte(counter++);
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(2) << hex << base;
+	return string("$" + ss.str() + ",Y");
 }
-bool CPU_6502::ANC()
+string CPU_6502::ABX_dis(uint16_t& counter)
 {
-	return false;
+	uint8_t lsb = DisassembledByte(counter++);
+	uint16_t msb = (uint16_t)DisassembledByte(counter++);
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(4) << hex << (lsb | (msb << 8));
+	return string("$" + ss.str() + ",X");
 }
-bool CPU_6502::ALR()
+string CPU_6502::ABY_dis(uint16_t& counter)
 {
-	return false;
+	uint8_t lsb = DisassembledByte(counter++);
+	uint16_t msb = (uint16_t)DisassembledByte(counter++);
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(4) << hex << (lsb | (msb << 8));
+	return string("$" + ss.str() + ",Y");
 }
-bool CPU_6502::ARR()
+string CPU_6502::IZX_dis(uint16_t& counter)
 {
-	return false;
+	uint8_t pointer = DisassembledByte(counter++);
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(2) << hex << (int)pointer;
+	return string("($" + ss.str() + ",X)");
 }
-bool CPU_6502::XAA()
+string CPU_6502::IZY_dis(uint16_t& counter)
 {
-	return false;
+	uint8_t pointer = DisassembledByte(counter++);
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(2) << hex << (int)pointer;
+	return string("($" + ss.str() + "),Y");
 }
-bool CPU_6502::AXS()
+string CPU_6502::IMP_dis(uint16_t& counter)
 {
-	return false;
+	return string("");
 }
-bool CPU_6502::AHX()
+string CPU_6502::IMM_dis(uint16_t& counter)
 {
-	//opCodeString = "AHX";
-	return false;
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(2) << hex << (int)DisassembledByte(counter++);
+	return string("#$" + ss.str());
 }
-bool CPU_6502::SHY()
+string CPU_6502::ZP_dis(uint16_t& counter)
 {
-	return false;
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(2) << hex << DisassembledByte(counter++);
+	return string("$" + ss.str());
 }
-bool CPU_6502::SHX()
+string CPU_6502::ABS_dis(uint16_t& counter)
 {
-	return false;
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(4) << hex << (DisassembledByte(counter++) | (uint16_t)(DisassembledByte(counter++) << 8));
+	return string("$" + ss.str());
 }
-bool CPU_6502::TAS()
+string CPU_6502::REL_dis(uint16_t& counter)
 {
-	return false;
+	uint8_t offset = DisassembledByte(counter++);
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(2) << hex << (uint16_t)offset;
+	return string("$" + ss.str());
 }
-bool CPU_6502::LAS()
+string CPU_6502::IND_dis(uint16_t& counter)
 {
-	return false;
+	uint16_t pointer = DisassembledByte(counter++) | (uint16_t)(DisassembledByte(counter++) << 8);
+	stringstream ss;
+	ss << uppercase << setfill('0') << setw(4) << hex << pointer;
+	return string("($" + ss.str() + ")");
 }
-bool CPU_6502::KIL()
+
+
+// *******
+// Helpers
+// *******
+void CPU_6502::INT(uint16_t vector)
 {
-	return false;
+	status.B = 0x10;
+	Push((pc & 0xFF00) >> 8);
+	Push(pc & 0x00FF);
+	Push(PackStatus());
+	uint16_t lsb = bus->Read(vector);
+	pc = lsb | (uint16_t)(bus->Read(vector + 1) << 8);
+	status.I = 1;
 }
 
 void CPU_6502::AddCarry(uint8_t data)	// Implemented in one place for both ADC and SBC
 {
 	bool checkV = (regA & 0x80) == (data & 0x80);	// Both numbers have same sign?
-	regA += data + status.C;
+	uint16_t sum = regA + data + GetC();
+	regA = (uint8_t)sum;
 	SetV(checkV && ((regA & 0x80) != (data & 0x80)));
-	SetC(regA < data);
-	SetZ(regA == 0);
-	SetN(regA & 0x80);
+	SetC(sum > 0xFF);		// Carry in can overflow on its own, so regA < data misses A + $FF + 1
+	SetNZ(regA);
 }
 
-void CPU_6502::Compare(uint8_t a, uint8_t b)	// Implemented in one place for CMP,CPX and CPY
+uint8_t CPU_6502::Compare(uint8_t a, uint8_t b)	// Implemented in one place for CMP,CPX and CPY
 {
 	uint8_t res = a - b;
-	SetN(res & 0x80);
-	SetZ(res == 0);
-	SetC(a < res);
+	SetNZ(res);
+	SetC(a >= b);		// No borrow
+	return res;
 }
 
 uint8_t CPU_6502::Decrement(uint8_t a)
 {
 	a--;
-	SetN(a & 0x80);
-	SetZ(a == 0);
+	SetNZ(a);
 	return a;
 }
 
 uint8_t CPU_6502::Increment(uint8_t a)
 {
 	a++;
-	SetN(a & 0x80);
-	SetZ(a == 0);
+	SetNZ(a);
 	return a;
 }
 
-
-
-// ***************
-// Status Register
-// ***************
-inline bool CPU_6502::SetN(bool n)
-{
-	return status.N = n;
-}
-inline bool CPU_6502::SetV(bool v)
+#ifdef CPU_OPCODE_PROFILE
+uint8_t CPU_6502::CountOpCode(uint8_t opCode, uint8_t cycles)
 {
-	return status.V = v;
+	OpCodeCounter& counter = opCodeCounters[opCode];
+	counter.count++;
+	counter.cycles += cycles;
+	counter.penalties += cycles - opCodes[opCode].cycles;
+	return cycles;
 }
-inline bool CPU_6502::SetD(bool d)
-{
-	return status.D = d;
-}
-inline bool CPU_6502::SetI(bool i)
-{
-	return status.I = i;
-}
-inline bool CPU_6502::SetZ(bool z)
+
+void CPU_6502::ResetOpCodeProfile()
 {
-	return status.Z = z;
+	for (OpCodeCounter& counter : opCodeCounters)
+		counter = OpCodeCounter();
 }
-inline bool CPU_6502::SetC(bool c)
+
+void CPU_6502::WriteOpCodeProfile(std::ostream& out, ProfileFormat format) const
 {
-	return status.C = c;
+#define MODE_NAME(mode) #mode,
+	static const char* const modeNames[] = { CPU_6502_MODES(MODE_NAME) };
+#undef MODE_NAME
+
+	// Opcodes that never ran are left out
+	bool first = true;
+	if (format == PROFILE_CSV)
+		out << "opcode,instruction,mode,count,cycles,penalty_cycles\n";
+	else
+		out << "[\n";
+	for (int i = 0; i < 0x100; i++)
+	{
+		const OpCodeCounter& counter = opCodeCounters[i];
+		if (!counter.count)
+			continue;
+
+		stringstream code;
+		code << "0x" << uppercase << setfill('0') << setw(2) << hex << i;
+		if (format == PROFILE_CSV)
+		{
+			out << code.str() << ',' << opCodeInfo[i].opCode << ',' << modeNames[opCodeInfo[i].mode] << ',' <<
+				counter.count << ',' << counter.cycles << ',' << counter.penalties << '\n';
+		}
+		else
+		{
+			out << (first ? "" : ",\n") << "\t{ \"opcode\": \"" << code.str() << "\", \"instruction\": \"" << opCodeInfo[i].opCode <<
+				"\", \"mode\": \"" << modeNames[opCodeInfo[i].mode] << "\", \"count\": " << counter.count << ", \"cycles\": " <<
+				counter.cycles << ", \"penalty_cycles\": " << counter.penalties << " }";
+		}
+		first = false;
+	}
+	if (format == PROFILE_JSON)
+		out << (first ? "" : "\n") << "]\n";
 }
+#endif
@@ -3,14 +3,57 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <ostream>
 #include "Bus.h"
+#include "ConsoleState.h"
+#include "CPU_6502_OpCodes.h"
+
+#define CPU_FUSED_DISPATCH	// Dispatch through the fused opcode switch (comment out to use the opcode table)
+#define CPU_LAZY_FLAGS		// Evaluate N, Z, C and V only when the status register is read
+#define CPU_DECODE_CACHE	// Predecode instructions in PRG-ROM ($8000-$FFFF) instead of fetching them every time
+#define CPU_SUPERINSTRUCTIONS	// Run common instruction pairs in PRG-ROM through fused handlers (needs CPU_DECODE_CACHE)
+#define CPU_DIRECT_RAM		// Zero page and stack accesses go straight to RAM when the bus maps RAM pages there (comment out for hosts where they may be I/O)
+#define CPU_IDLE_SKIP		// Fast-forward spin loops to the end of a RunCycles/RunUntil batch
+#define CPU_RECOMPILER		// Build the basic block recompiler (x86-64 hosts only, off until SetRecompilerMode is called)
+#define CPU_THREADED_CODE	// Build the portable threaded code engine (off until SetThreadedCode is called)
+#define CPU_STATIC_BUS		// Bind the CPU to the NES memory map at compile time (NESBus), comment out to use any Bus
+//#define CPU_OPCODE_PROFILE	// Count executions, cycles and page cross penalties per opcode (see WriteOpCodeProfile)
+
+#ifdef BUS_ACCESS_HEATMAP		// Set in Bus.h, only accesses that reach the bus are counted
+#undef CPU_DECODE_CACHE
+#undef CPU_DIRECT_RAM
+#undef CPU_IDLE_SKIP
+#undef CPU_RECOMPILER
+#undef CPU_THREADED_CODE
+#endif
+#if defined(CPU_SUPERINSTRUCTIONS) && !defined(CPU_DECODE_CACHE)
+#undef CPU_SUPERINSTRUCTIONS
+#endif
+#if defined(CPU_RECOMPILER) && !(defined(_M_X64) || defined(__x86_64__))
+#undef CPU_RECOMPILER
+#endif
+#ifdef CPU_OPCODE_PROFILE		// The counters are in the interpreter, so everything has to run on it
+#undef CPU_SUPERINSTRUCTIONS
+#undef CPU_RECOMPILER
+#undef CPU_THREADED_CODE
+#endif
+
+#ifdef CPU_STATIC_BUS
+#include "NESBus.h"
+#endif
 
 using namespace std;
 
-class CPU_6502
+class CPU_6502 : private BusWatcher
 {
 public:
-	CPU_6502(Bus *bus);
+#ifdef CPU_STATIC_BUS
+	typedef NESBus BusType;
+#else
+	typedef Bus BusType;
+#endif
+
+	CPU_6502(BusType *bus, ConsoleState* state);
 	~CPU_6502();
 
 	struct DisassembledInstruction
@@ -20,11 +63,50 @@ public:
 		uint8_t instructionSize;
 	};
 
+	enum RecompilerMode
+	{
+		RECOMPILER_OFF,
+		RECOMPILER_ON,
+		RECOMPILER_CHECKED		// Replays every recompiled block on the interpreter and throws if the results differ
+	};
+
+	enum ProfileFormat { PROFILE_CSV, PROFILE_JSON };
+
+	enum StopReason { STOP_NONE, STOP_BREAKPOINT, STOP_WATCHPOINT };
+
+	enum IRQSource : uint8_t	// Devices that can hold the IRQ line
+	{
+		IRQ_APU_FRAME = 0x01,
+		IRQ_DMC = 0x02,
+		IRQ_MAPPER = 0x04,
+		IRQ_EXTERNAL = 0x08
+	};
+
 	void Reset();
+	void OnStateLoaded();		// Picks the registers up from the console state after a state was copied in
 	bool Clock();
 	void Step();
-	void IRQ();
-	void NMI();
+	uint32_t RunCycles(uint32_t budget, uint32_t eventCycles = 0);		// Runs whole instructions until the budget is used, returns cycles consumed
+	uint32_t RunUntil(uint64_t targetCycle, uint64_t eventCycle = 0);	// Runs whole instructions until the cycle count is reached, returns the overshoot.
+						// An idle loop can be skipped past the target up to eventCycle, the next thing that could end it (vblank, IRQ).
+	uint64_t GetCycleCount() const;
+	uint64_t GetSkippedCycles() const;			// Cycles fast-forwarded through idle loops
+	void SetCycleExact(bool exact);		// Selects the micro-op core, takes effect at the next instruction boundary
+	bool IsCycleExact() const;
+	bool SetRecompilerMode(RecompilerMode mode);	// Returns false if the recompiler isn't available on this build or host
+	bool SetThreadedCode(bool enabled);			// Returns false if threaded code isn't available on this build, the recompiler takes precedence
+	bool SetSuperinstructions(bool enabled);	// On by default, returns false if superinstructions aren't available on this build
+	void SetIRQ(IRQSource source, bool asserted);	// IRQ is level triggered, taken while any source holds it and I is clear
+	void SetNMI(bool asserted);		// NMI is edge triggered, an assertion is latched until it is taken
+	void IRQ();						// Asserts IRQ_EXTERNAL
+	void NMI();						// Pulses the NMI line
+	void Stall(uint16_t cycles, bool evenAligned);	// Halts for cycles once the current instruction is done (DMA), evenAligned adds one if the halt starts on an odd cycle
+	void SetBreakpoint(uint16_t address, bool enabled);		// Execution stops before the instruction at address, running again resumes with it
+	void SetWatchpoint(uint16_t address, uint8_t types);	// Bus::WatchType bits (0 removes it), execution stops after the instruction making the access
+	StopReason GetStopReason() const;	// Why the last Clock, Step or run stopped early, STOP_NONE if it didn't
+	uint16_t GetStopAddress() const;	// Breakpoint or watched address of the last stop
+	uint8_t GetStopData() const;		// Byte read or written by the access that hit a watchpoint
+	Bus::WatchType GetStopType() const;	// Whether that access was a read or a write
 	uint8_t GetA() const;
 	uint8_t GetX() const;
 	uint8_t GetY() const;
@@ -32,40 +114,85 @@ public:
 	uint16_t GetProgramCounter() const;
 	uint8_t GetStackPointer() const;
 	const std::vector<CPU_6502::DisassembledInstruction>* Disassemble(uint16_t startAddress, uint16_t size);
+#ifdef CPU_OPCODE_PROFILE
+	void ResetOpCodeProfile();
+	void WriteOpCodeProfile(std::ostream& out, ProfileFormat format) const;
+#endif
 
 
 private:
 
-	enum InterruptType { INTERRUPT_NONE, INTERRUPT_IRQ, INTERRUPT_NMI };
+	enum InterruptType { INTERRUPT_NONE, INTERRUPT_IRQ, INTERRUPT_NMI, INTERRUPT_BREAK };
+
+	// Compile-time opcode handlers (see CPU_6502_Ops.h)
+	struct AddressingMode;
+	struct Operation;
+	template<class Mode, class Instruction> struct Op;
+	template<class First, class Second> struct FusedOp;
+	template<class Mode, class Instruction> struct MicroOp;		// Cycle-exact handlers (see CPU_6502_MicroOps.h)
+	template<class Instruction> struct MicroAccess;
+	struct MicroInterrupt;
+	class Recompiler;			// Native code for PRG-ROM basic blocks (see CPU_6502_Recompiler.h)
+	class ThreadedCode;			// Handler arrays for PRG-ROM instruction runs (see CPU_6502_Threaded.h)
 
-	struct OpCode
+#define MODE_INDEX(mode) MODE_##mode,
+	enum ModeIndex : uint8_t { CPU_6502_MODES(MODE_INDEX) };
+#undef MODE_INDEX
+
+	struct OpCode			// Hot dispatch data
 	{
-		bool (CPU_6502::* instruction)();
-		bool (CPU_6502::* mode)();
+		uint8_t (*handler)(CPU_6502& cpu);	// Returns extra cycles taken
+		uint8_t (*run)(CPU_6502& cpu, uint16_t operand);	// Same, with the operand already fetched
 		uint8_t cycles;
+		uint8_t size;		// Operand bytes
+	};
+
+	struct DecodedInstruction	// Decode cache entry
+	{
+		uint8_t (*run)(CPU_6502& cpu, uint16_t operand);	// NULL if the instruction can't be cached
+		uint32_t generation;	// Bus generation of the block the instruction was decoded from
+		uint16_t operand;
+		uint8_t size;			// Opcode and operand bytes
+		uint8_t cycles;
+		uint8_t opCode;
+		uint8_t (*fused)(CPU_6502& cpu, uint16_t first, uint16_t second);	// Superinstruction for this and the next instruction, or NULL
+		uint16_t nextOperand;
+		uint8_t fusedSize;
+		uint8_t fusedCycles;
+	};
+
+	struct FusedPair
+	{
+		uint8_t first;
+		uint8_t second;
+		uint8_t (*run)(CPU_6502& cpu, uint16_t first, uint16_t second);
+	};
+
+	struct OpCodeInfo		// Cold disassembly data
+	{
 		const char* opCode;
-		string(CPU_6502::* mode_dis)(uint16_t&);
+		ModeIndex mode;
 	};
 
-	using a = CPU_6502;
-	OpCode opCodes[0x100] = {
-		{&a::BRK, &a::IMP, 7, "BRK", &a::IMP_dis}, {&a::ORA, &a::IZX, 6, "ORA", &a::IZX_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::SLO, &a::IZX, 8, "SLO", &a::IZX_dis}, {&a::NOP, &a::ZP, 3, "NOP", &a::ZP_dis}, {&a::ORA, &a::ZP, 3, "ORA", &a::ZP_dis}, {&a::ASL, &a::ZP, 5, "ASL", &a::ZP_dis}, {&a::SLO, &a::ZP, 5, "SLO", &a::ZP_dis}, {&a::PHP, &a::IMP, 3, "PHP", &a::IMP_dis}, {&a::ORA, &a::IMM, 2, "ORA", &a::IMM_dis}, {&a::ASL, &a::IMP, 2, "ASL", &a::IMP_dis}, {&a::ANC, &a::IMM, 2, "ANC", &a::IMM_dis}, {&a::NOP, &a::ABS, 4, "NOP", &a::ABS_dis}, {&a::ORA, &a::ABS, 4, "ORA", &a::ABS_dis}, {&a::ASL, &a::ABS, 6, "ASL", &a::ABS_dis}, {&a::SLO, &a::ABS, 6, "SLO", &a::ABS_dis},
-		{&a::BPL, &a::REL, 2, "BPL", &a::REL_dis}, {&a::ORA, &a::IZY, 5, "ORA", &a::IZY_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::SLO, &a::IZY, 8, "SLO", &a::IZY_dis}, {&a::NOP, &a::ZPX, 4, "NOP", &a::ZPX_dis}, {&a::ORA, &a::ZPX, 4, "ORA", &a::ZPX_dis}, {&a::ASL, &a::ZPX, 6, "ASL", &a::ZPX_dis}, {&a::SLO, &a::ZPX, 6, "SLO", &a::ZPX_dis}, {&a::CLC, &a::IMP, 2, "CLC", &a::IMP_dis}, {&a::ORA, &a::ABY, 4, "ORA", &a::ABY_dis}, {&a::NOP, &a::IMP, 2, "NOP", &a::IMP_dis}, {&a::SLO, &a::ABY, 2, "SLO", &a::ABY_dis}, {&a::NOP, &a::ABX, 4, "NOP", &a::ABX_dis}, {&a::ORA, &a::ABX, 4, "ORA", &a::ABX_dis}, {&a::ASL, &a::ABX, 7, "ASL", &a::ABX_dis}, {&a::SLO, &a::ABX, 7, "SLO", &a::ABX_dis},
-		{&a::JSR, &a::ABS, 6, "JSR", &a::ABS_dis}, {&a::AND, &a::IZX, 6, "AND", &a::IZX_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::RLA, &a::IZX, 8, "RLA", &a::IZX_dis}, {&a::BIT, &a::ZP, 3, "BIT", &a::ZP_dis}, {&a::AND, &a::ZP, 3, "AND", &a::ZP_dis}, {&a::ROL, &a::ZP, 5, "ROL", &a::ZP_dis}, {&a::RLA, &a::ZP, 5, "RLA", &a::ZP_dis}, {&a::PLP, &a::IMP, 4, "PLP", &a::IMP_dis}, {&a::AND, &a::IMM, 2, "AND", &a::IMM_dis}, {&a::ROL, &a::IMP, 2, "ROL", &a::IMP_dis}, {&a::ANC, &a::IMM, 2, "ANC", &a::IMM_dis}, {&a::BIT, &a::ABS, 4, "BIT", &a::ABS_dis}, {&a::AND, &a::ABS, 4, "AND", &a::ABS_dis}, {&a::ROL, &a::ABS, 6, "ROL", &a::ABS_dis}, {&a::RLA, &a::ABS, 6, "RLA", &a::ABS_dis},
-		{&a::BMI, &a::REL, 2, "BMI", &a::REL_dis}, {&a::AND, &a::IZY, 5, "AND", &a::IZY_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::RLA, &a::IZY, 8, "RLA", &a::IZY_dis}, {&a::NOP, &a::ZPX, 4, "NOP", &a::ZPX_dis}, {&a::AND, &a::ZPX, 4, "AND", &a::ZPX_dis}, {&a::ROL, &a::ZPX, 6, "ROL", &a::ZPX_dis}, {&a::RLA, &a::ZPX, 6, "RLA", &a::ZPX_dis}, {&a::SEC, &a::IMP, 2, "SEC", &a::IMP_dis}, {&a::AND, &a::ABY, 4, "AND", &a::ABY_dis}, {&a::NOP, &a::IMP, 2, "NOP", &a::IMP_dis}, {&a::RLA, &a::ABY, 7, "rla", &a::ABY_dis}, {&a::NOP, &a::ABX, 4, "NOP", &a::ABX_dis}, {&a::AND, &a::ABX, 4, "AND", &a::ABX_dis}, {&a::ROL, &a::ABX, 7, "ROL", &a::ABX_dis}, {&a::RLA, &a::ABX, 7, "RLA", &a::ABX_dis},
-		{&a::RTI, &a::IMP, 6, "RTI", &a::IMP_dis}, {&a::EOR, &a::IZX, 6, "EOR", &a::IZX_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::SRE, &a::IZX, 8, "SRE", &a::IZX_dis}, {&a::NOP, &a::ZP, 3, "NOP", &a::ZP_dis}, {&a::EOR, &a::ZP, 3, "EOR", &a::ZP_dis}, {&a::LSR, &a::ZP, 5, "LSR", &a::ZP_dis}, {&a::SRE, &a::ZP, 5, "SRE", &a::ZP_dis}, {&a::PHA, &a::IMP, 3, "PHA", &a::IMP_dis}, {&a::EOR, &a::IMM, 2, "EOR", &a::IMM_dis}, {&a::LSR, &a::IMP, 2, "LSR", &a::IMP_dis}, {&a::ALR, &a::IMM, 2, "ALR", &a::IMM_dis}, {&a::JMP, &a::ABS, 3, "JMP", &a::ABS_dis}, {&a::EOR, &a::ABS, 4, "EOR", &a::ABS_dis}, {&a::LSR, &a::ABS, 6, "LSR", &a::ABS_dis}, {&a::SRE, &a::ABS, 6, "SRE", &a::ABS_dis},
-		{&a::BVC, &a::REL, 2, "BVC", &a::REL_dis}, {&a::EOR, &a::IZY, 5, "EOR", &a::IZY_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::SRE, &a::IZY, 8, "SRE", &a::IZY_dis}, {&a::NOP, &a::ZPX, 4, "NOP", &a::ZPX_dis}, {&a::EOR, &a::ZPX, 4, "EOR", &a::ZPX_dis}, {&a::LSR, &a::ZPX, 6, "LSR", &a::ZPX_dis}, {&a::SRE, &a::ZPX, 6, "SRE", &a::ZPX_dis}, {&a::CLI, &a::IMP, 2, "CLI", &a::IMP_dis}, {&a::EOR, &a::ABY, 4, "EOR", &a::ABY_dis}, {&a::NOP, &a::IMP, 2, "NOP", &a::IMP_dis}, {&a::SRE, &a::ABY, 7, "SRE", &a::ABY_dis}, {&a::NOP, &a::ABX, 4, "NOP", &a::ABX_dis}, {&a::EOR, &a::ABX, 4, "EOR", &a::ABX_dis}, {&a::LSR, &a::ABX, 7, "LSR", &a::ABX_dis}, {&a::SRE, &a::ABX, 7, "SRE", &a::ABX_dis},
-		{&a::RTS, &a::IMP, 6, "RTS", &a::IMP_dis}, {&a::ADC, &a::IZX, 6, "ADC", &a::IZX_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::RRA, &a::IZX, 8, "RRA", &a::IZX_dis}, {&a::NOP, &a::ZP, 3, "NOP", &a::ZP_dis}, {&a::ADC, &a::ZP, 3, "ADC", &a::ZP_dis}, {&a::ROR, &a::ZP, 5, "ROR", &a::ZP_dis}, {&a::RRA, &a::ZP, 5, "RRA", &a::ZP_dis}, {&a::PLA, &a::IMP, 4, "PLA", &a::IMP_dis}, {&a::ADC, &a::IMM, 2, "ADC", &a::IMM_dis}, {&a::ROR, &a::IMP, 2, "ROR", &a::IMP_dis}, {&a::ARR, &a::IMM, 2, "ARR", &a::IMM_dis}, {&a::JMP, &a::IND, 5, "JMP", &a::IND_dis}, {&a::ADC, &a::ABS, 4, "ADC", &a::ABS_dis}, {&a::ROR, &a::ABS, 6, "ROR", &a::ABS_dis}, {&a::RRA, &a::ABS, 6, "RRA", &a::ABS_dis},
-		{&a::BVS, &a::REL, 2, "BVS", &a::REL_dis}, {&a::ADC, &a::IZY, 5, "ADC", &a::IZY_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::RRA, &a::IZY, 8, "RRA", &a::IZY_dis}, {&a::NOP, &a::ZPX, 4, "NOP", &a::ZPX_dis}, {&a::ADC, &a::ZPX, 4, "ADC", &a::ZPX_dis}, {&a::ROR, &a::ZPX, 6, "ROR", &a::ZPX_dis}, {&a::RRA, &a::ZPX, 6, "RRA", &a::ZPX_dis}, {&a::SEI, &a::IMP, 2, "SEI", &a::IMP_dis}, {&a::ADC, &a::ABY, 4, "ADC", &a::ABY_dis}, {&a::NOP, &a::IMP, 2, "NOP", &a::IMP_dis}, {&a::RRA, &a::ABY, 7, "RRA", &a::ABY_dis}, {&a::NOP, &a::ABX, 4, "NOP", &a::ABX_dis}, {&a::ADC, &a::ABX, 4, "ADC", &a::ABX_dis}, {&a::ROR, &a::ABX, 7, "ROR", &a::ABX_dis}, {&a::RRA, &a::ABX, 7, "RRA", &a::ABX_dis},
-		{&a::NOP, &a::IMM, 2, "NOP", &a::IMM_dis}, {&a::STA, &a::IZX, 6, "STA", &a::IZX_dis}, {&a::NOP, &a::IMM, 2, "NOP", &a::IMM_dis}, {&a::SAX, &a::IZX, 6, "SAX", &a::IZX_dis}, {&a::STY, &a::ZP, 3, "STY", &a::ZP_dis}, {&a::STA, &a::ZP, 3, "STA", &a::ZP_dis}, {&a::STX, &a::ZP, 3, "STX", &a::ZP_dis}, {&a::SAX, &a::ZP, 3, "SAX", &a::ZP_dis}, {&a::DEY, &a::IMP, 2, "DEY", &a::IMP_dis}, {&a::NOP, &a::IMM, 2, "NOP", &a::IMM_dis}, {&a::TXA, &a::IMP, 2, "TXA", &a::IMP_dis}, {&a::XAA, &a::IMM, 2, "XAA", &a::IMM_dis}, {&a::STY, &a::ABS, 4, "STY", &a::ABS_dis}, {&a::STA, &a::ABS, 4, "STA", &a::ABS_dis}, {&a::STX, &a::ABS, 4, "STX", &a::ABS_dis}, {&a::SAX, &a::ABS, 4, "SAX", &a::ABS_dis},
-		{&a::BCC, &a::REL, 2, "BCC", &a::REL_dis}, {&a::STA, &a::IZY, 6, "STA", &a::IZY_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::AHX, &a::IZY, 6, "AHX", &a::IZY_dis}, {&a::STY, &a::ZPX, 4, "STY", &a::ZPX_dis}, {&a::STA, &a::ZPX, 4, "STA", &a::ZPX_dis}, {&a::STX, &a::ZPY, 4, "STX", &a::ZPY_dis}, {&a::SAX, &a::ZPY, 4, "SAX", &a::ZPY_dis}, {&a::TYA, &a::IMP, 2, "TYA", &a::IMP_dis}, {&a::STA, &a::ABY, 5, "STA", &a::ABY_dis}, {&a::TXS, &a::IMP, 2, "TXS", &a::IMP_dis}, {&a::TAS, &a::ABY, 5, "TAS", &a::ABY_dis}, {&a::SHY, &a::ABX, 5, "SHY", &a::ABX_dis}, {&a::STA, &a::ABX, 5, "STA", &a::ABX_dis}, {&a::SHX, &a::ABY, 5, "SHX", &a::ABY_dis}, {&a::AHX, &a::ABY, 5, "AHX", &a::ABY_dis},
-		{&a::LDY, &a::IMM, 2, "LDY", &a::IMM_dis}, {&a::LDA, &a::IZX, 6, "LDA", &a::IZX_dis}, {&a::LDX, &a::IMM, 2, "LDX", &a::IMM_dis}, {&a::LAX, &a::IZX, 6, "LAX", &a::IZX_dis}, {&a::LDY, &a::ZP, 3, "LDY", &a::ZP_dis}, {&a::LDA, &a::ZP, 3, "LDA", &a::ZP_dis}, {&a::LDX, &a::ZP, 3, "LDX", &a::ZP_dis}, {&a::LAX, &a::ZP, 3, "LAX", &a::ZP_dis}, {&a::TAY, &a::IMP, 2, "TAY", &a::IMP_dis}, {&a::LDA, &a::IMM, 2, "LDA", &a::IMM_dis}, {&a::TAX, &a::IMP, 2, "TAX", &a::IMP_dis}, {&a::LAX, &a::IMM, 2, "LAX", &a::IMM_dis}, {&a::LDY, &a::ABS, 4, "LDY", &a::ABS_dis}, {&a::LDA, &a::ABS, 4, "LDA", &a::ABS_dis}, {&a::LDX, &a::ABS, 4, "LDX", &a::ABS_dis}, {&a::LAX, &a::ABS, 4, "LAX", &a::ABS_dis},
-		{&a::BCS, &a::REL, 2, "BCS", &a::REL_dis}, {&a::LDA, &a::IZY, 5, "LDA", &a::IZY_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::LAX, &a::IZY, 5, "LAX", &a::IZY_dis}, {&a::LDY, &a::ZPX, 4, "LDY", &a::ZPX_dis}, {&a::LDA, &a::ZPX, 4, "LDA", &a::ZPX_dis}, {&a::LDX, &a::ZPY, 4, "LDX", &a::ZPY_dis}, {&a::LAX, &a::ZPY, 4, "LAX", &a::ZPY_dis}, {&a::CLV, &a::IMP, 2, "CLV", &a::IMP_dis}, {&a::LDA, &a::ABY, 4, "LDA", &a::ABY_dis}, {&a::TSX, &a::IMP, 2, "TSX", &a::IMP_dis}, {&a::LAS, &a::ABY, 4, "LAS", &a::ABY_dis}, {&a::LDY, &a::ABX, 4, "LDY", &a::ABX_dis}, {&a::LDA, &a::ABX, 4, "LDA", &a::ABX_dis}, {&a::LDX, &a::ABY, 4, "LDX", &a::ABY_dis}, {&a::LAX, &a::ABY, 4, "LAX", &a::ABY_dis},
-		{&a::CPY, &a::IMM, 2, "CPY", &a::IMM_dis}, {&a::CMP, &a::IZX, 6, "CMP", &a::IZX_dis}, {&a::NOP, &a::IMM, 2, "NOP", &a::IMM_dis}, {&a::DCP, &a::IZX, 8, "DCP", &a::IZX_dis}, {&a::CPY, &a::ZP, 3, "CPY", &a::ZP_dis}, {&a::CMP, &a::ZP, 3, "CMP", &a::ZP_dis}, {&a::DEC, &a::ZP, 5, "DEC", &a::ZP_dis}, {&a::DCP, &a::ZP, 5, "DCP", &a::ZP_dis}, {&a::INY, &a::IMP, 2, "INY", &a::IMP_dis}, {&a::CMP, &a::IMM, 2, "CMP", &a::IMM_dis}, {&a::DEX, &a::IMP, 2, "DEX", &a::IMP_dis}, {&a::AXS, &a::IMM, 2, "AXS", &a::IMM_dis}, {&a::CPY, &a::ABS, 4, "CPY", &a::ABS_dis}, {&a::CMP, &a::ABS, 4, "CMP", &a::ABS_dis}, {&a::DEC, &a::ABS, 6, "DEC", &a::ABS_dis}, {&a::DCP, &a::ABS, 6, "DCP", &a::ABS_dis},
-		{&a::BNE, &a::REL, 2, "BNE", &a::REL_dis}, {&a::CMP, &a::IZY, 5, "CMP", &a::IZY_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::DCP, &a::IZY, 8, "DCP", &a::IZY_dis}, {&a::NOP, &a::ZPX, 4, "NOP", &a::ZPX_dis}, {&a::CMP, &a::ZPX, 4, "CMP", &a::ZPX_dis}, {&a::DEC, &a::ZPX, 6, "DEC", &a::ZPX_dis}, {&a::DCP, &a::ZPX, 6, "DCP", &a::ZPX_dis}, {&a::CLD, &a::IMP, 2, "CLD", &a::IMP_dis}, {&a::CMP, &a::ABY, 4, "CMP", &a::ABY_dis}, {&a::NOP, &a::IMP, 2, "NOP", &a::IMP_dis}, {&a::DCP, &a::ABY, 7, "DCP", &a::ABY_dis}, {&a::NOP, &a::ABX, 4, "NOP", &a::ABX_dis}, {&a::CMP, &a::ABX, 4, "CMP", &a::ABX_dis}, {&a::DEC, &a::ABX, 7, "DEC", &a::ABX_dis}, {&a::DCP, &a::ABX, 7, "DCP", &a::ABX_dis},
-		{&a::CPX, &a::IMM, 2, "CPX", &a::IMM_dis}, {&a::SBC, &a::IZX, 6, "SBC", &a::IZX_dis}, {&a::NOP, &a::IMM, 2, "NOP", &a::IMM_dis}, {&a::ISC, &a::IZX, 8, "ISC", &a::IZX_dis}, {&a::CPX, &a::ZP, 3, "CPX", &a::ZP_dis}, {&a::SBC, &a::ZP, 3, "SBC", &a::ZP_dis}, {&a::INC, &a::ZP, 5, "INC", &a::ZP_dis}, {&a::ISC, &a::ZP, 5, "ISC", &a::ZP_dis}, {&a::INX, &a::IMP, 2, "INX", &a::IMP_dis}, {&a::SBC, &a::IMM, 2, "SBC", &a::IMM_dis}, {&a::NOP, &a::IMP, 2, "NOP", &a::IMP_dis}, {&a::SBC, &a::IMM, 2, "SBC", &a::IMM_dis}, {&a::CPX, &a::ABS, 4, "CPX", &a::ABS_dis}, {&a::SBC, &a::ABS, 4, "SBC", &a::ABS_dis}, {&a::INC, &a::ABS, 6, "INC", &a::ABS_dis}, {&a::ISC, &a::ABS, 6, "ISC", &a::ABS_dis},
-		{&a::BEQ, &a::REL, 2, "BEQ", &a::REL_dis}, {&a::SBC, &a::IZY, 5, "SBC", &a::IZY_dis}, {&a::KIL, &a::IMP, 1, "KIL", &a::IMP_dis}, {&a::ISC, &a::IZY, 8, "ISC", &a::IZY_dis}, {&a::NOP, &a::ZPX, 4, "NOP", &a::ZPX_dis}, {&a::SBC, &a::ZPX, 4, "SBC", &a::ZPX_dis}, {&a::INC, &a::ZPX, 6, "INC", &a::ZPX_dis}, {&a::ISC, &a::ZPX, 6, "ISC", &a::ZPX_dis}, {&a::SED, &a::IMP, 2, "SED", &a::IMP_dis}, {&a::SBC, &a::ABY, 4, "SBC", &a::ABY_dis}, {&a::NOP, &a::IMP, 2, "NOP", &a::IMP_dis}, {&a::ISC, &a::ABY, 7, "ISC", &a::ABY_dis}, {&a::NOP, &a::ABX, 4, "NOP", &a::ABX_dis}, {&a::SBC, &a::ABX, 4, "SBC", &a::ABX_dis}, {&a::INC, &a::ABX, 7, "INC", &a::ABX_dis}, {&a::ISC, &a::ABX, 7, "ISC", &a::ABX_dis}
+	// Opcode tables are shared by all instances
+	static const OpCode opCodes[0x100];
+#define OPCODE_INFO_ENTRY(code, instruction, mode, cycles) { #instruction, MODE_##mode },
+	static constexpr OpCodeInfo opCodeInfo[0x100] = {
+		CPU_6502_OPCODES(OPCODE_INFO_ENTRY)
 	};
+#undef OPCODE_INFO_ENTRY
+
+	typedef bool (*MicroHandler)(CPU_6502& cpu);	// Runs one cycle of an instruction, returns true on the last one
+	static const MicroHandler microOps[0x100];
+
+	static const bool readOnlyOpCodes[0x100];	// Opcodes that can't change anything but registers and flags
+	static const uint8_t accessTypes[0x100];	// Operation::AccessType of every opcode
+	static const FusedPair fusedPairs[];		// See CPU_6502_FUSED_PAIRS
+
+	static string (CPU_6502::* const modeDisassemblers[])(uint16_t&);
+
+	static const uint8_t INTERRUPT_CYCLES = 7;
+	static const uint8_t IDLE_LOOP_SIZE = 0x20;	// Longest loop body checked for idling
 
 
 	// *********
@@ -91,145 +218,341 @@ private:
 
 	
 	// Class Globals
-	bool bImplied;
-	uint16_t address;
-	uint8_t data;
-	Bus* bus;
-	InterruptType currentInterrupt;
+	BusType* bus;
+	ConsoleState* state;		// The registers are stored to it after every run and loaded back by OnStateLoaded
+
+	// Interrupt controller. The IRQ sources asserting the line are in the low byte, next to the latched
+	// NMI and the delayed I flag, so a single test of interruptLines tells if there is anything to poll.
+	static const uint16_t INTERRUPT_IRQ_SOURCES = 0x00FF;
+	static const uint16_t INTERRUPT_NMI_LATCHED = 0x0100;
+	static const uint16_t INTERRUPT_I_DELAYED = 0x0200;
+	static const uint16_t INTERRUPT_DEBUG = 0x0400;		// Breakpoints or watchpoints need every instruction boundary
+	uint16_t interruptLines;
+
+	// Pages $00 and $01 are always internal RAM on the NES, so when the bus can hand them out the zero page
+	// and stack go straight to memory. Writes through them don't change the bus generation of block 0, which
+	// only matters for code that runs from the zero page or stack. The pages are taken when the CPU is built
+	// and again whenever a watchpoint is set, which takes a watched page off the direct path.
+	uint8_t* zeroPage;			// NULL to go through the bus
+	uint8_t* stackPage;
+	bool nmiLine;
+	bool delayedI;				// I from before the last CLI, SEI or PLP, which is what the poll after it sees
+	uint16_t currentCycle;		// Cycles remaining in the current instruction, and any halt after it
+	uint16_t stallCycles;		// Halt asked for by Stall, taken when the instruction making it is done
+	bool stallAligned;
+	uint64_t totalCycles;		// Cycles run since power on
 	std::vector<DisassembledInstruction> disassembleInfo;
 	std::map<uint16_t, int> instructionMap;
+	std::vector<uint8_t> disassembleBytes;		// The range being disassembled, peeked in one go
+	uint16_t disassembleStart;
+	std::vector<DecodedInstruction> decodeCache;	// One entry per PRG-ROM address
+	bool superinstructions;		// Decode fuses the pairs in CPU_6502_FUSED_PAIRS
 
+	struct IdleLoop			// Last short backward branch taken in RunUntil
+	{
+		uint16_t branch;
+		uint16_t target;
+		uint32_t generation;	// Bus generation of the block holding the branch
+		bool readOnly;			// Loop body only reads memory
+		uint8_t a, x, y, sp, p;	// Registers the last time the branch was taken
+		uint64_t cycle;
+	} idleLoop;
+	uint64_t skippedCycles;
+	Recompiler* recompiler;		// NULL when recompilation is off
+	ThreadedCode* threadedCode;	// NULL when threaded code is off
 
-	// ****************
-	// Addressing Modes
-	// ****************
-	bool ZPX();		// Zero Page Indexed (X)
-	string ZPX_dis(uint16_t& counter);
-	bool ZPY();		// Zero Page Indexed (Y)
-	string ZPY_dis(uint16_t& counter);
-	bool ABX();		// Absolute Indexed (X)
-	string ABX_dis(uint16_t& counter);
-	bool ABY();		// Absolute Indexed (Y)
-	string ABY_dis(uint16_t& counter);
-	bool IZX();		// Indexed Indirect
-	string IZX_dis(uint16_t& counter);
-	bool IZY();		// Indirect Indexed
-	string IZY_dis(uint16_t& counter);
-	bool IMP();		// Implicit
-	string IMP_dis(uint16_t& counter);
-	bool IMM();		// Immediate
-	string IMM_dis(uint16_t& counter);
-	bool ZP();		// Zero Page
-	string ZP_dis(uint16_t& counter);
-	bool ABS();		// Absolute
-	string ABS_dis(uint16_t& counter);
-	bool REL();		// Relative
-	string REL_dis(uint16_t& counter);
-	bool IND();		// Indirect
-	string IND_dis(uint16_t& counter);
-
-
-	// ************
-	// Instructions
-	// ************
-	
-	// Logical and Arithmetic Commands
-	bool ORA();
-	bool AND();
-	bool EOR();
-	bool ADC();
-	bool SBC();
-	bool CMP();
-	bool CPX();
-	bool CPY();
-	bool DEC();
-	bool DEX();
-	bool DEY();
-	bool INC();
-	bool INX();
-	bool INY();
-	bool ASL();
-	bool ROL();
-	bool LSR();
-	bool ROR();
-
-	// Move Commands
-	bool LDA();
-	bool STA();
-	bool LDX();
-	bool STX();
-	bool LDY();
-	bool STY();
-	bool TAX();
-	bool TXA();
-	bool TAY();
-	bool TYA();
-	bool TSX();
-	bool TXS();
-	bool PLA();
-	bool PHA();
-	bool PLP();
-	bool PHP();
-
-	// Jump/Flag Commands
-	bool BPL();
-	bool BMI();
-	bool BVC();
-	bool BVS();
-	bool BCC();
-	bool BCS();
-	bool BNE();
-	bool BEQ();
-	bool BRK();
-	bool INT();
-	bool RTI();
-	bool JSR();
-	bool RTS();
-	bool JMP();
-	bool BIT();
-	bool CLC();
-	bool SEC();
-	bool CLD();
-	bool SED();
-	bool CLI();
-	bool SEI();
-	bool CLV();
-	bool NOP();
-
-	// Illegal Opcodes
-	bool SLO();
-	bool RLA();
-	bool SRE();
-	bool RRA();
-	bool SAX();
-	bool LAX();
-	bool DCP();
-	bool ISC();
-	bool ANC();
-	bool ALR();
-	bool ARR();
-	bool XAA();
-	bool AXS();
-	bool AHX();
-	bool SHY();
-	bool SHX();
-	bool TAS();
-	bool LAS();
-	bool KIL();
+	// Debugging. A breakpoint in PRG-ROM turns its decode cache entry into a trap, and blocks, threads and
+	// pairs are built to end in front of it, so it costs nothing until it is reached. Breakpoints the decode
+	// cache doesn't cover (code in RAM, the micro-op core) and watchpoints set INTERRUPT_DEBUG instead,
+	// which sends every instruction boundary through PollInterrupts. The caches peek the code they are
+	// filled from and leave out pages with a read watchpoint, so read watchpoints see every fetch of the code
+	// on them and nothing else. A stop takes no cycles: whatever ran into it returns 0 for the instruction that didn't run.
+	std::vector<bool> breakpoints;	// One per address
+	uint32_t breakpointCount;
+	uint32_t romBreakpoints;		// Breakpoints the decode cache traps
+	std::map<uint16_t, uint8_t> watchpoints;
+	StopReason stopReason;
+	uint16_t stopAddress;
+	uint8_t stopData;			// Access that hit a watchpoint
+	Bus::WatchType stopType;
+	bool resuming;				// Stopped at a breakpoint, the next check at stopAddress lets the instruction run
+	uint64_t runTarget;			// Cycle RunUntil runs to, a stop pulls it in
+
+	// Micro-op core state, only meaningful while an instruction is in progress
+	bool cycleExact;			// Run instructions one bus access per cycle
+	MicroHandler microOp;		// Handler of the instruction in progress, NULL between instructions
+	uint8_t microStep;			// Cycle of the instruction about to run (the opcode fetch is cycle 1)
+	uint16_t microAddress;		// Effective address (or vector) being built up
+	uint8_t microData;			// Latched operand byte
+	bool microPageCrossed;		// Indexed address needs its high byte fixed up
+
+#ifdef CPU_OPCODE_PROFILE
+	struct OpCodeCounter
+	{
+		uint64_t count;
+		uint64_t cycles;
+		uint64_t penalties;		// Cycles on top of the base cycles (page crossings, and taken branches on the micro-op core)
+	};
+	OpCodeCounter opCodeCounters[0x100];
+	uint16_t microOpCode;		// Opcode on the micro-op core, 0x100 while an interrupt is in progress
+
+	uint8_t CountOpCode(uint8_t opCode, uint8_t cycles);	// Returns cycles
+#endif
+
+	uint8_t RunInstruction();			// Runs the next instruction or pending interrupt, returns cycles taken
+	uint32_t RunBlock(uint16_t& lastInstruction);	// Runs a recompiled block, thread or superinstruction if there is one, otherwise one instruction
+	uint8_t Execute(uint8_t opCode);	// Fused addressing mode + instruction handler, returns cycles taken
+	bool MicroStep();					// Runs one cycle on the micro-op core, returns true when the instruction is done
+	void Decode(DecodedInstruction& instruction, uint16_t address);
+	void DecodeFused(DecodedInstruction& instruction, uint8_t opCode, uint16_t address);
+	bool FetchCached(uint16_t address, uint16_t start, uint8_t& opCode, uint16_t& operand) const;	// Instruction for the caches, see Decode
+	void CheckIdleLoop(uint16_t branch, uint64_t targetCycle);
+	bool IsReadOnlyLoop(uint16_t start, uint16_t branch) const;
+	static bool EndsBlock(uint8_t opCode);		// Branches, jumps, calls and returns
+	uint16_t TakeStall(uint64_t cycle);	// Cycles of the pending halt, starting at cycle
+	void MapDirectPages();
+	void LoadRegisters();				// From the console state, only between instructions
+	void StoreRegisters();
+	void StoreInterrupts();				// Interrupt lines and halt only, so they are saved even when set between runs
+	void MarkDirectPages();				// Direct zero page and stack writes skip the bus, so their pages are marked dirty up front
+	bool StopAtBreakpoint();			// Checks the breakpoint at pc, returns true to stop
+	void UpdateDebugPolling();
+	void OnWatch(uint16_t address, uint8_t data, Bus::WatchType type) override;
+	static uint8_t Breakpoint(CPU_6502& cpu, uint16_t operand);	// Decode cache trap
 
+
+	// ***********
+	// Disassembly
+	// ***********
+	uint8_t DisassembledByte(uint16_t address) const;
+	string ZPX_dis(uint16_t& counter);	// Zero Page Indexed (X)
+	string ZPY_dis(uint16_t& counter);	// Zero Page Indexed (Y)
+	string ABX_dis(uint16_t& counter);	// Absolute Indexed (X)
+	string ABY_dis(uint16_t& counter);	// Absolute Indexed (Y)
+	string IZX_dis(uint16_t& counter);	// Indexed Indirect
+	string IZY_dis(uint16_t& counter);	// Indirect Indexed
+	string IMP_dis(uint16_t& counter);	// Implicit
+	string IMM_dis(uint16_t& counter);	// Immediate
+	string ZP_dis(uint16_t& counter);	// Zero Page
+	string ABS_dis(uint16_t& counter);	// Absolute
+	string REL_dis(uint16_t& counter);	// Relative
+	string IND_dis(uint16_t& counter);	// Indirect
+
+
+	// *******
+	// Helpers
+	// *******
+	void INT(uint16_t vector);
 	void AddCarry(uint8_t data);
-	void Compare(uint8_t a, uint8_t b);
+	uint8_t Compare(uint8_t a, uint8_t b);		// Returns a - b, which N and Z are set from
 	uint8_t Decrement(uint8_t a);
 	uint8_t Increment(uint8_t a);
 
 	// ***************
 	// Status Register
 	// ***************
+#ifdef CPU_LAZY_FLAGS
+	// N and Z are kept as the bytes they were derived from (N is bit 7 of flagN, Z is set when flagZ is zero)
+	// and C and V as plain bytes, so setting them never touches the status bitfield. status.p only holds
+	// I, D and B and is merged with the lazy flags when something reads the whole register (PackStatus).
+	uint8_t flagN;
+	uint8_t flagZ;
+	bool flagC;
+	bool flagV;
+#endif
 	bool SetN(bool n);
 	bool SetV(bool v);
 	bool SetD(bool d);
 	bool SetI(bool i);
 	bool SetZ(bool z);
 	bool SetC(bool c);
+	void SetNZ(uint8_t result);		// N and Z from a result byte
+	bool GetN() const;
+	bool GetV() const;
+	bool GetZ() const;
+	bool GetC() const;
+	uint8_t PackStatus() const;		// Entire register with all flags materialized
+	void UnpackStatus(uint8_t p);
+	uint8_t ReadZeroPage(uint8_t address) const;
+	void WriteZeroPage(uint8_t address, uint8_t data);
+	void Push(uint8_t data);
+	uint8_t Pull();
+	void DelayInterruptMask();		// Called by CLI, SEI and PLP before they change I
+	InterruptType PollInterrupts();	// Interrupt to take before the next instruction, only needed when interruptLines is set
 };
 
+
+// ***************
+// Status Register
+// ***************
+#ifdef CPU_LAZY_FLAGS
+inline bool CPU_6502::SetN(bool n)
+{
+	flagN = n ? 0x80 : 0x00;
+	return n;
+}
+inline bool CPU_6502::SetV(bool v)
+{
+	return flagV = v;
+}
+inline bool CPU_6502::SetZ(bool z)
+{
+	flagZ = z ? 0x00 : 0x01;
+	return z;
+}
+inline bool CPU_6502::SetC(bool c)
+{
+	return flagC = c;
+}
+inline void CPU_6502::SetNZ(uint8_t result)
+{
+	flagN = flagZ = result;
+}
+inline bool CPU_6502::GetN() const
+{
+	return (flagN & 0x80) != 0;
+}
+inline bool CPU_6502::GetV() const
+{
+	return flagV;
+}
+inline bool CPU_6502::GetZ() const
+{
+	return flagZ == 0;
+}
+inline bool CPU_6502::GetC() const
+{
+	return flagC;
+}
+inline uint8_t CPU_6502::PackStatus() const
+{
+	return (status.p & 0x3C) | (flagN & 0x80) | (flagV ? 0x40 : 0x00) | (flagZ ? 0x00 : 0x02) | (flagC ? 0x01 : 0x00);
+}
+inline void CPU_6502::UnpackStatus(uint8_t p)
+{
+	status.p = p;
+	flagN = p;
+	flagZ = ~p & 0x02;
+	flagC = (p & 0x01) != 0;
+	flagV = (p & 0x40) != 0;
+}
+#else
+inline bool CPU_6502::SetN(bool n)
+{
+	status.N = n;
+	return n;
+}
+inline bool CPU_6502::SetV(bool v)
+{
+	status.V = v;
+	return v;
+}
+inline bool CPU_6502::SetZ(bool z)
+{
+	status.Z = z;
+	return z;
+}
+inline bool CPU_6502::SetC(bool c)
+{
+	status.C = c;
+	return c;
+}
+inline void CPU_6502::SetNZ(uint8_t result)
+{
+	status.N = result >> 7;
+	status.Z = result == 0;
+}
+inline bool CPU_6502::GetN() const
+{
+	return status.N;
+}
+inline bool CPU_6502::GetV() const
+{
+	return status.V;
+}
+inline bool CPU_6502::GetZ() const
+{
+	return status.Z;
+}
+inline bool CPU_6502::GetC() const
+{
+	return status.C;
+}
+inline uint8_t CPU_6502::PackStatus() const
+{
+	return status.p;
+}
+inline void CPU_6502::UnpackStatus(uint8_t p)
+{
+	status.p = p;
+}
+#endif
+inline bool CPU_6502::SetD(bool d)
+{
+	status.D = d;
+	return d;
+}
+inline bool CPU_6502::SetI(bool i)
+{
+	status.I = i;
+	return i;
+}
+
+
+// *******************
+// Zero Page and Stack
+// *******************
+inline uint8_t CPU_6502::ReadZeroPage(uint8_t address) const
+{
+#ifdef CPU_DIRECT_RAM
+	if (zeroPage)
+		return zeroPage[address];
+#endif
+	return bus->Read(address);
+}
+inline void CPU_6502::WriteZeroPage(uint8_t address, uint8_t data)
+{
+#ifdef CPU_DIRECT_RAM
+	if (zeroPage)
+	{
+		zeroPage[address] = data;
+		return;
+	}
+#endif
+	bus->Write(address, data);
+}
+inline void CPU_6502::Push(uint8_t data)
+{
+#ifdef CPU_DIRECT_RAM
+	if (stackPage)
+	{
+		stackPage[sp--] = data;
+		return;
+	}
+#endif
+	bus->Write(sp-- | 0x0100, data);
+}
+inline uint8_t CPU_6502::Pull()
+{
+#ifdef CPU_DIRECT_RAM
+	if (stackPage)
+		return stackPage[++sp];
+#endif
+	return bus->Read(++sp | 0x0100);
+}
+inline void CPU_6502::MarkDirectPages()
+{
+#ifdef CPU_DIRECT_RAM
+	if (zeroPage)
+		bus->SetDirty(0x0000);
+	if (stackPage)
+		bus->SetDirty(0x0100);
+#endif
+}
+inline void CPU_6502::DelayInterruptMask()
+{
+	// The 6502 polls for interrupts before the last cycle of an instruction, so the change to I
+	// only counts from the poll after the next instruction
+	delayedI = status.I;
+	interruptLines |= INTERRUPT_I_DELAYED;
+}
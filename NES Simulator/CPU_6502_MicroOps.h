@@ -0,0 +1,525 @@
+#pragma once
+#include "CPU_6502.h"
+#include "CPU_6502_Ops.h"
+#include "Bus.h"
+#include <cstdint>
+#include <type_traits>
+
+// Cycle-exact opcode handlers
+//
+// MicroOp<Mode, Instruction> runs the same instruction policies as Op<Mode, Instruction>, but spreads the
+// instruction out over one call per cycle with exactly one bus access in each, including the dummy reads
+// of the indexed modes and the dummy write of read-modify-write instructions. cpu.microStep is the cycle
+// being run (cycle 1, the opcode fetch, is done by MicroStep) and Step returns true on the last cycle.
+// Anything carried from one cycle to the next lives in the micro* members; the registers are the same
+// ones the fast core uses, so the two can be swapped between instructions.
+
+
+// **************
+// Operand Access
+// **************
+//
+// The cycles after the effective address is known, counted from the first one that touches the operand.
+template<class Instruction>
+struct CPU_6502::MicroAccess
+{
+	struct Latched			// Operand read by an earlier cycle
+	{
+		static uint8_t Load(CPU_6502& cpu, uint16_t address)
+		{
+			return cpu.microData;
+		}
+		static void Store(CPU_6502& cpu, uint16_t address, uint8_t data)
+		{
+			cpu.bus->Write(address, data);
+		}
+	};
+
+	// Zero page operands normally skip the bus (CPU_DIRECT_RAM), but here every cycle is a bus access
+	template<class Mode, bool zeroPage = std::is_base_of<AddressingMode::ZeroPageOperand, Mode>::value>
+	struct OnBus : Mode {};
+	template<class Mode>
+	struct OnBus<Mode, true> : Mode
+	{
+		static uint8_t Load(CPU_6502& cpu, uint16_t address)
+		{
+			return cpu.bus->Read(address);
+		}
+		static void Store(CPU_6502& cpu, uint16_t address, uint8_t data)
+		{
+			cpu.bus->Write(address, data);
+		}
+	};
+
+	template<class Mode> static bool Run(CPU_6502& cpu, uint8_t step)
+	{
+		if (Instruction::access != Operation::ACCESS_READ_MODIFY_WRITE)
+		{
+			Instruction::template Execute<OnBus<Mode> >(cpu, cpu.microAddress);
+			return true;
+		}
+		switch (step)
+		{
+		case 0:
+			cpu.microData = cpu.bus->Read(cpu.microAddress);
+			return false;
+		case 1:
+			cpu.bus->Write(cpu.microAddress, cpu.microData);	// Dummy write of the unmodified value
+			return false;
+		}
+		Instruction::template Execute<Latched>(cpu, cpu.microAddress);
+		return true;
+	}
+
+	// The first cycle after indexing reads from the address before its high byte is fixed up. Reads that
+	// stayed in the page take that as the real access, everything else does the access again.
+	template<class Mode> static bool Indexed(CPU_6502& cpu, uint8_t step)
+	{
+		if (step == 0)
+		{
+			if (Instruction::access == Operation::ACCESS_READ && !cpu.microPageCrossed)
+				return Run<Mode>(cpu, 0);
+			cpu.bus->Read(cpu.microPageCrossed ? cpu.microAddress - 0x0100 : cpu.microAddress);
+			return false;
+		}
+		return Run<Mode>(cpu, step - 1);
+	}
+
+	static void Index(CPU_6502& cpu, uint16_t base, uint8_t index)
+	{
+		cpu.microAddress = base + index;
+		cpu.microPageCrossed = (cpu.microAddress & 0xFF00) != (base & 0xFF00);
+	}
+};
+
+
+// ****************
+// Addressing Modes
+// ****************
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IMP, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		cpu.bus->Read(cpu.pc);		// Dummy read of the next byte
+		Instruction::Implied(cpu);
+		return true;
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IMM, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		Instruction::template Execute<AddressingMode::IMM>(cpu, cpu.bus->Read(cpu.pc++));
+		return true;
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::ZP, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		if (cpu.microStep == 2)
+		{
+			cpu.microAddress = cpu.bus->Read(cpu.pc++);
+			return false;
+		}
+		return MicroAccess<Instruction>::template Run<AddressingMode::ZP>(cpu, cpu.microStep - 3);
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::ZPX, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microAddress = cpu.bus->Read(cpu.pc++);
+			return false;
+		case 3:
+			cpu.bus->Read(cpu.microAddress);		// Dummy read while the index is added
+			cpu.microAddress = (cpu.microAddress + cpu.regX) & 0x00FF;
+			return false;
+		}
+		return MicroAccess<Instruction>::template Run<AddressingMode::ZPX>(cpu, cpu.microStep - 4);
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::ZPY, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microAddress = cpu.bus->Read(cpu.pc++);
+			return false;
+		case 3:
+			cpu.bus->Read(cpu.microAddress);		// Dummy read while the index is added
+			cpu.microAddress = (cpu.microAddress + cpu.regY) & 0x00FF;
+			return false;
+		}
+		return MicroAccess<Instruction>::template Run<AddressingMode::ZPY>(cpu, cpu.microStep - 4);
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::ABS, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microAddress = cpu.bus->Read(cpu.pc++);
+			return false;
+		case 3:
+			cpu.microAddress |= (uint16_t)(cpu.bus->Read(cpu.pc++) << 8);
+			return false;
+		}
+		return MicroAccess<Instruction>::template Run<AddressingMode::ABS>(cpu, cpu.microStep - 4);
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::ABX, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microAddress = cpu.bus->Read(cpu.pc++);
+			return false;
+		case 3:
+			MicroAccess<Instruction>::Index(cpu, cpu.microAddress | (uint16_t)(cpu.bus->Read(cpu.pc++) << 8), cpu.regX);
+			return false;
+		}
+		return MicroAccess<Instruction>::template Indexed<AddressingMode::ABX>(cpu, cpu.microStep - 4);
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::ABY, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microAddress = cpu.bus->Read(cpu.pc++);
+			return false;
+		case 3:
+			MicroAccess<Instruction>::Index(cpu, cpu.microAddress | (uint16_t)(cpu.bus->Read(cpu.pc++) << 8), cpu.regY);
+			return false;
+		}
+		return MicroAccess<Instruction>::template Indexed<AddressingMode::ABY>(cpu, cpu.microStep - 4);
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IZX, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microData = cpu.bus->Read(cpu.pc++);
+			return false;
+		case 3:
+			cpu.bus->Read(cpu.microData);			// Dummy read while the index is added
+			cpu.microData += cpu.regX;				// Pointer wraps within the zero page
+			return false;
+		case 4:
+			cpu.microAddress = cpu.bus->Read(cpu.microData);
+			return false;
+		case 5:
+			cpu.microAddress |= (uint16_t)(cpu.bus->Read((uint8_t)(cpu.microData + 1)) << 8);
+			return false;
+		}
+		return MicroAccess<Instruction>::template Run<AddressingMode::IZX>(cpu, cpu.microStep - 6);
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IZY, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microData = cpu.bus->Read(cpu.pc++);
+			return false;
+		case 3:
+			cpu.microAddress = cpu.bus->Read(cpu.microData);
+			return false;
+		case 4:
+			MicroAccess<Instruction>::Index(cpu, cpu.microAddress | (uint16_t)(cpu.bus->Read((uint8_t)(cpu.microData + 1)) << 8), cpu.regY);
+			return false;
+		}
+		return MicroAccess<Instruction>::template Indexed<AddressingMode::IZY>(cpu, cpu.microStep - 5);
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::REL, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microData = cpu.bus->Read(cpu.pc++);
+			return !Instruction::Taken(cpu);
+		case 3:
+			cpu.bus->Read(cpu.pc);					// Dummy read of the next opcode
+			cpu.microAddress = cpu.pc + (int8_t)cpu.microData;
+			cpu.microPageCrossed = (cpu.microAddress & 0xFF00) != (cpu.pc & 0xFF00);
+			cpu.pc = (cpu.pc & 0xFF00) | (cpu.microAddress & 0x00FF);
+			return !cpu.microPageCrossed;
+		}
+		cpu.bus->Read(cpu.pc);						// Dummy read before the high byte is fixed up
+		cpu.pc = cpu.microAddress;
+		return true;
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IND, Instruction>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microAddress = cpu.bus->Read(cpu.pc++);
+			return false;
+		case 3:
+			cpu.microAddress |= (uint16_t)(cpu.bus->Read(cpu.pc++) << 8);
+			return false;
+		case 4:
+			cpu.microData = cpu.bus->Read(cpu.microAddress);
+			return false;
+		}
+		Instruction::template Execute<AddressingMode::IND>(cpu, cpu.microData | (uint16_t)(cpu.bus->Read(cpu.microAddress + 1) << 8));
+		return true;
+	}
+};
+
+
+// **********************
+// Stack and Control Flow
+// **********************
+//
+// These access memory more than once on their own, so they are written out cycle by cycle. Return
+// addresses follow the fast core: JSR pushes the address of the next instruction and RTS pulls it as is.
+struct CPU_6502::MicroInterrupt		// IRQ, NMI and BRK, vector in microAddress
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.bus->Read(cpu.pc);
+			return false;
+		case 3:
+			cpu.bus->Write(cpu.sp-- | 0x0100, (cpu.pc & 0xFF00) >> 8);
+			return false;
+		case 4:
+			cpu.bus->Write(cpu.sp-- | 0x0100, cpu.pc & 0x00FF);
+			return false;
+		case 5:
+			cpu.bus->Write(cpu.sp-- | 0x0100, cpu.PackStatus());
+			return false;
+		case 6:
+			cpu.microData = cpu.bus->Read(cpu.microAddress);
+			return false;
+		}
+		cpu.pc = cpu.microData | (uint16_t)(cpu.bus->Read(cpu.microAddress + 1) << 8);
+		cpu.status.I = 1;
+		return true;
+	}
+};
+
+template<>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IMP, CPU_6502::Operation::BRK>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		if (cpu.microStep == 2)
+		{
+			cpu.status.B = 0x11;
+			cpu.microAddress = 0xFFFE;
+		}
+		return MicroInterrupt::Step(cpu);
+	}
+};
+
+template<>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IMP, CPU_6502::Operation::PHA>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		if (cpu.microStep == 2)
+		{
+			cpu.bus->Read(cpu.pc);
+			return false;
+		}
+		cpu.bus->Write(cpu.sp-- | 0x0100, cpu.regA);	// Not Operation::PHA, its push skips the bus
+		return true;
+	}
+};
+
+template<>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IMP, CPU_6502::Operation::PHP>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		if (cpu.microStep == 2)
+		{
+			cpu.bus->Read(cpu.pc);
+			return false;
+		}
+		cpu.status.B = 0x11;							// Not Operation::PHP, its push skips the bus
+		cpu.bus->Write(cpu.sp-- | 0x0100, cpu.PackStatus());
+		return true;
+	}
+};
+
+template<>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IMP, CPU_6502::Operation::PLA>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.bus->Read(cpu.pc);
+			return false;
+		case 3:
+			cpu.bus->Read(cpu.sp | 0x0100);			// Dummy stack read while sp is incremented
+			return false;
+		}
+		cpu.regA = cpu.bus->Read(++cpu.sp | 0x0100);	// Not Operation::PLA, its pull skips the bus
+		cpu.SetNZ(cpu.regA);
+		return true;
+	}
+};
+
+template<>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IMP, CPU_6502::Operation::PLP>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.bus->Read(cpu.pc);
+			return false;
+		case 3:
+			cpu.bus->Read(cpu.sp | 0x0100);			// Dummy stack read while sp is incremented
+			return false;
+		}
+		cpu.DelayInterruptMask();						// Not Operation::PLP, its pull skips the bus
+		cpu.UnpackStatus(cpu.bus->Read(++cpu.sp | 0x0100));
+		return true;
+	}
+};
+
+template<>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IMP, CPU_6502::Operation::RTS>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.bus->Read(cpu.pc);
+			return false;
+		case 3:
+			cpu.bus->Read(cpu.sp | 0x0100);
+			return false;
+		case 4:
+			cpu.microData = cpu.bus->Read(++cpu.sp | 0x0100);
+			return false;
+		case 5:
+			cpu.pc = cpu.microData | (uint16_t)(cpu.bus->Read(++cpu.sp | 0x0100) << 8);
+			return false;
+		}
+		cpu.bus->Read(cpu.pc);
+		return true;
+	}
+};
+
+template<>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::IMP, CPU_6502::Operation::RTI>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.bus->Read(cpu.pc);
+			return false;
+		case 3:
+			cpu.bus->Read(cpu.sp | 0x0100);
+			return false;
+		case 4:
+			cpu.UnpackStatus(cpu.bus->Read(++cpu.sp | 0x0100));
+			return false;
+		case 5:
+			cpu.microData = cpu.bus->Read(++cpu.sp | 0x0100);
+			return false;
+		}
+		cpu.pc = cpu.microData | (uint16_t)(cpu.bus->Read(++cpu.sp | 0x0100) << 8);
+		return true;
+	}
+};
+
+template<>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::ABS, CPU_6502::Operation::JMP>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		if (cpu.microStep == 2)
+		{
+			cpu.microAddress = cpu.bus->Read(cpu.pc++);
+			return false;
+		}
+		Operation::JMP::Execute<AddressingMode::ABS>(cpu, cpu.microAddress | (uint16_t)(cpu.bus->Read(cpu.pc++) << 8));
+		return true;
+	}
+};
+
+template<>
+struct CPU_6502::MicroOp<CPU_6502::AddressingMode::ABS, CPU_6502::Operation::JSR>
+{
+	static bool Step(CPU_6502& cpu)
+	{
+		switch (cpu.microStep)
+		{
+		case 2:
+			cpu.microAddress = cpu.bus->Read(cpu.pc++);
+			return false;
+		case 3:
+			cpu.bus->Read(cpu.sp | 0x0100);
+			return false;
+		case 4:
+			cpu.bus->Write(cpu.sp-- | 0x0100, ((cpu.pc + 1) & 0xFF00) >> 8);	// pc still points at the high byte
+			return false;
+		case 5:
+			cpu.bus->Write(cpu.sp-- | 0x0100, (cpu.pc + 1) & 0x00FF);
+			return false;
+		}
+		cpu.pc = cpu.microAddress | (uint16_t)(cpu.bus->Read(cpu.pc) << 8);
+		return true;
+	}
+};
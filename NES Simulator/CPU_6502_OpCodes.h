@@ -0,0 +1,40 @@
+#pragma once
+
+// Addressing modes, in the order of the disassembler table
+#define CPU_6502_MODES(MODE) \
+	MODE(ZPX) MODE(ZPY) MODE(ABX) MODE(ABY) MODE(IZX) MODE(IZY) MODE(IMP) MODE(IMM) MODE(ZP) MODE(ABS) MODE(REL) MODE(IND)
+
+// 6502 opcode matrix (one row per high nibble of the opcode)
+// Each entry is expanded as OPCODE(opcode, instruction, addressing mode, base cycles) by whichever
+// dispatch engine includes this file, so the opcode table and the fused interpreter can't drift apart.
+#define CPU_6502_OPCODES(OPCODE) \
+	OPCODE(0x00, BRK, IMP, 7) OPCODE(0x01, ORA, IZX, 6) OPCODE(0x02, KIL, IMP, 1) OPCODE(0x03, SLO, IZX, 8) OPCODE(0x04, NOP, ZP, 3) OPCODE(0x05, ORA, ZP, 3) OPCODE(0x06, ASL, ZP, 5) OPCODE(0x07, SLO, ZP, 5) OPCODE(0x08, PHP, IMP, 3) OPCODE(0x09, ORA, IMM, 2) OPCODE(0x0A, ASL, IMP, 2) OPCODE(0x0B, ANC, IMM, 2) OPCODE(0x0C, NOP, ABS, 4) OPCODE(0x0D, ORA, ABS, 4) OPCODE(0x0E, ASL, ABS, 6) OPCODE(0x0F, SLO, ABS, 6) \
+	OPCODE(0x10, BPL, REL, 2) OPCODE(0x11, ORA, IZY, 5) OPCODE(0x12, KIL, IMP, 1) OPCODE(0x13, SLO, IZY, 8) OPCODE(0x14, NOP, ZPX, 4) OPCODE(0x15, ORA, ZPX, 4) OPCODE(0x16, ASL, ZPX, 6) OPCODE(0x17, SLO, ZPX, 6) OPCODE(0x18, CLC, IMP, 2) OPCODE(0x19, ORA, ABY, 4) OPCODE(0x1A, NOP, IMP, 2) OPCODE(0x1B, SLO, ABY, 2) OPCODE(0x1C, NOP, ABX, 4) OPCODE(0x1D, ORA, ABX, 4) OPCODE(0x1E, ASL, ABX, 7) OPCODE(0x1F, SLO, ABX, 7) \
+	OPCODE(0x20, JSR, ABS, 6) OPCODE(0x21, AND, IZX, 6) OPCODE(0x22, KIL, IMP, 1) OPCODE(0x23, RLA, IZX, 8) OPCODE(0x24, BIT, ZP, 3) OPCODE(0x25, AND, ZP, 3) OPCODE(0x26, ROL, ZP, 5) OPCODE(0x27, RLA, ZP, 5) OPCODE(0x28, PLP, IMP, 4) OPCODE(0x29, AND, IMM, 2) OPCODE(0x2A, ROL, IMP, 2) OPCODE(0x2B, ANC, IMM, 2) OPCODE(0x2C, BIT, ABS, 4) OPCODE(0x2D, AND, ABS, 4) OPCODE(0x2E, ROL, ABS, 6) OPCODE(0x2F, RLA, ABS, 6) \
+	OPCODE(0x30, BMI, REL, 2) OPCODE(0x31, AND, IZY, 5) OPCODE(0x32, KIL, IMP, 1) OPCODE(0x33, RLA, IZY, 8) OPCODE(0x34, NOP, ZPX, 4) OPCODE(0x35, AND, ZPX, 4) OPCODE(0x36, ROL, ZPX, 6) OPCODE(0x37, RLA, ZPX, 6) OPCODE(0x38, SEC, IMP, 2) OPCODE(0x39, AND, ABY, 4) OPCODE(0x3A, NOP, IMP, 2) OPCODE(0x3B, RLA, ABY, 7) OPCODE(0x3C, NOP, ABX, 4) OPCODE(0x3D, AND, ABX, 4) OPCODE(0x3E, ROL, ABX, 7) OPCODE(0x3F, RLA, ABX, 7) \
+	OPCODE(0x40, RTI, IMP, 6) OPCODE(0x41, EOR, IZX, 6) OPCODE(0x42, KIL, IMP, 1) OPCODE(0x43, SRE, IZX, 8) OPCODE(0x44, NOP, ZP, 3) OPCODE(0x45, EOR, ZP, 3) OPCODE(0x46, LSR, ZP, 5) OPCODE(0x47, SRE, ZP, 5) OPCODE(0x48, PHA, IMP, 3) OPCODE(0x49, EOR, IMM, 2) OPCODE(0x4A, LSR, IMP, 2) OPCODE(0x4B, ALR, IMM, 2) OPCODE(0x4C, JMP, ABS, 3) OPCODE(0x4D, EOR, ABS, 4) OPCODE(0x4E, LSR, ABS, 6) OPCODE(0x4F, SRE, ABS, 6) \
+	OPCODE(0x50, BVC, REL, 2) OPCODE(0x51, EOR, IZY, 5) OPCODE(0x52, KIL, IMP, 1) OPCODE(0x53, SRE, IZY, 8) OPCODE(0x54, NOP, ZPX, 4) OPCODE(0x55, EOR, ZPX, 4) OPCODE(0x56, LSR, ZPX, 6) OPCODE(0x57, SRE, ZPX, 6) OPCODE(0x58, CLI, IMP, 2) OPCODE(0x59, EOR, ABY, 4) OPCODE(0x5A, NOP, IMP, 2) OPCODE(0x5B, SRE, ABY, 7) OPCODE(0x5C, NOP, ABX, 4) OPCODE(0x5D, EOR, ABX, 4) OPCODE(0x5E, LSR, ABX, 7) OPCODE(0x5F, SRE, ABX, 7) \
+	OPCODE(0x60, RTS, IMP, 6) OPCODE(0x61, ADC, IZX, 6) OPCODE(0x62, KIL, IMP, 1) OPCODE(0x63, RRA, IZX, 8) OPCODE(0x64, NOP, ZP, 3) OPCODE(0x65, ADC, ZP, 3) OPCODE(0x66, ROR, ZP, 5) OPCODE(0x67, RRA, ZP, 5) OPCODE(0x68, PLA, IMP, 4) OPCODE(0x69, ADC, IMM, 2) OPCODE(0x6A, ROR, IMP, 2) OPCODE(0x6B, ARR, IMM, 2) OPCODE(0x6C, JMP, IND, 5) OPCODE(0x6D, ADC, ABS, 4) OPCODE(0x6E, ROR, ABS, 6) OPCODE(0x6F, RRA, ABS, 6) \
+	OPCODE(0x70, BVS, REL, 2) OPCODE(0x71, ADC, IZY, 5) OPCODE(0x72, KIL, IMP, 1) OPCODE(0x73, RRA, IZY, 8) OPCODE(0x74, NOP, ZPX, 4) OPCODE(0x75, ADC, ZPX, 4) OPCODE(0x76, ROR, ZPX, 6) OPCODE(0x77, RRA, ZPX, 6) OPCODE(0x78, SEI, IMP, 2) OPCODE(0x79, ADC, ABY, 4) OPCODE(0x7A, NOP, IMP, 2) OPCODE(0x7B, RRA, ABY, 7) OPCODE(0x7C, NOP, ABX, 4) OPCODE(0x7D, ADC, ABX, 4) OPCODE(0x7E, ROR, ABX, 7) OPCODE(0x7F, RRA, ABX, 7) \
+	OPCODE(0x80, NOP, IMM, 2) OPCODE(0x81, STA, IZX, 6) OPCODE(0x82, NOP, IMM, 2) OPCODE(0x83, SAX, IZX, 6) OPCODE(0x84, STY, ZP, 3) OPCODE(0x85, STA, ZP, 3) OPCODE(0x86, STX, ZP, 3) OPCODE(0x87, SAX, ZP, 3) OPCODE(0x88, DEY, IMP, 2) OPCODE(0x89, NOP, IMM, 2) OPCODE(0x8A, TXA, IMP, 2) OPCODE(0x8B, XAA, IMM, 2) OPCODE(0x8C, STY, ABS, 4) OPCODE(0x8D, STA, ABS, 4) OPCODE(0x8E, STX, ABS, 4) OPCODE(0x8F, SAX, ABS, 4) \
+	OPCODE(0x90, BCC, REL, 2) OPCODE(0x91, STA, IZY, 6) OPCODE(0x92, KIL, IMP, 1) OPCODE(0x93, AHX, IZY, 6) OPCODE(0x94, STY, ZPX, 4) OPCODE(0x95, STA, ZPX, 4) OPCODE(0x96, STX, ZPY, 4) OPCODE(0x97, SAX, ZPY, 4) OPCODE(0x98, TYA, IMP, 2) OPCODE(0x99, STA, ABY, 5) OPCODE(0x9A, TXS, IMP, 2) OPCODE(0x9B, TAS, ABY, 5) OPCODE(0x9C, SHY, ABX, 5) OPCODE(0x9D, STA, ABX, 5) OPCODE(0x9E, SHX, ABY, 5) OPCODE(0x9F, AHX, ABY, 5) \
+	OPCODE(0xA0, LDY, IMM, 2) OPCODE(0xA1, LDA, IZX, 6) OPCODE(0xA2, LDX, IMM, 2) OPCODE(0xA3, LAX, IZX, 6) OPCODE(0xA4, LDY, ZP, 3) OPCODE(0xA5, LDA, ZP, 3) OPCODE(0xA6, LDX, ZP, 3) OPCODE(0xA7, LAX, ZP, 3) OPCODE(0xA8, TAY, IMP, 2) OPCODE(0xA9, LDA, IMM, 2) OPCODE(0xAA, TAX, IMP, 2) OPCODE(0xAB, LAX, IMM, 2) OPCODE(0xAC, LDY, ABS, 4) OPCODE(0xAD, LDA, ABS, 4) OPCODE(0xAE, LDX, ABS, 4) OPCODE(0xAF, LAX, ABS, 4) \
+	OPCODE(0xB0, BCS, REL, 2) OPCODE(0xB1, LDA, IZY, 5) OPCODE(0xB2, KIL, IMP, 1) OPCODE(0xB3, LAX, IZY, 5) OPCODE(0xB4, LDY, ZPX, 4) OPCODE(0xB5, LDA, ZPX, 4) OPCODE(0xB6, LDX, ZPY, 4) OPCODE(0xB7, LAX, ZPY, 4) OPCODE(0xB8, CLV, IMP, 2) OPCODE(0xB9, LDA, ABY, 4) OPCODE(0xBA, TSX, IMP, 2) OPCODE(0xBB, LAS, ABY, 4) OPCODE(0xBC, LDY, ABX, 4) OPCODE(0xBD, LDA, ABX, 4) OPCODE(0xBE, LDX, ABY, 4) OPCODE(0xBF, LAX, ABY, 4) \
+	OPCODE(0xC0, CPY, IMM, 2) OPCODE(0xC1, CMP, IZX, 6) OPCODE(0xC2, NOP, IMM, 2) OPCODE(0xC3, DCP, IZX, 8) OPCODE(0xC4, CPY, ZP, 3) OPCODE(0xC5, CMP, ZP, 3) OPCODE(0xC6, DEC, ZP, 5) OPCODE(0xC7, DCP, ZP, 5) OPCODE(0xC8, INY, IMP, 2) OPCODE(0xC9, CMP, IMM, 2) OPCODE(0xCA, DEX, IMP, 2) OPCODE(0xCB, AXS, IMM, 2) OPCODE(0xCC, CPY, ABS, 4) OPCODE(0xCD, CMP, ABS, 4) OPCODE(0xCE, DEC, ABS, 6) OPCODE(0xCF, DCP, ABS, 6) \
+	OPCODE(0xD0, BNE, REL, 2) OPCODE(0xD1, CMP, IZY, 5) OPCODE(0xD2, KIL, IMP, 1) OPCODE(0xD3, DCP, IZY, 8) OPCODE(0xD4, NOP, ZPX, 4) OPCODE(0xD5, CMP, ZPX, 4) OPCODE(0xD6, DEC, ZPX, 6) OPCODE(0xD7, DCP, ZPX, 6) OPCODE(0xD8, CLD, IMP, 2) OPCODE(0xD9, CMP, ABY, 4) OPCODE(0xDA, NOP, IMP, 2) OPCODE(0xDB, DCP, ABY, 7) OPCODE(0xDC, NOP, ABX, 4) OPCODE(0xDD, CMP, ABX, 4) OPCODE(0xDE, DEC, ABX, 7) OPCODE(0xDF, DCP, ABX, 7) \
+	OPCODE(0xE0, CPX, IMM, 2) OPCODE(0xE1, SBC, IZX, 6) OPCODE(0xE2, NOP, IMM, 2) OPCODE(0xE3, ISC, IZX, 8) OPCODE(0xE4, CPX, ZP, 3) OPCODE(0xE5, SBC, ZP, 3) OPCODE(0xE6, INC, ZP, 5) OPCODE(0xE7, ISC, ZP, 5) OPCODE(0xE8, INX, IMP, 2) OPCODE(0xE9, SBC, IMM, 2) OPCODE(0xEA, NOP, IMP, 2) OPCODE(0xEB, SBC, IMM, 2) OPCODE(0xEC, CPX, ABS, 4) OPCODE(0xED, SBC, ABS, 4) OPCODE(0xEE, INC, ABS, 6) OPCODE(0xEF, ISC, ABS, 6) \
+	OPCODE(0xF0, BEQ, REL, 2) OPCODE(0xF1, SBC, IZY, 5) OPCODE(0xF2, KIL, IMP, 1) OPCODE(0xF3, ISC, IZY, 8) OPCODE(0xF4, NOP, ZPX, 4) OPCODE(0xF5, SBC, ZPX, 4) OPCODE(0xF6, INC, ZPX, 6) OPCODE(0xF7, ISC, ZPX, 6) OPCODE(0xF8, SED, IMP, 2) OPCODE(0xF9, SBC, ABY, 4) OPCODE(0xFA, NOP, IMP, 2) OPCODE(0xFB, ISC, ABY, 7) OPCODE(0xFC, NOP, ABX, 4) OPCODE(0xFD, SBC, ABX, 4) OPCODE(0xFE, INC, ABX, 7) OPCODE(0xFF, ISC, ABX, 7)
+
+// Superinstructions, picked from the pairs that show up most in game code (copy loops, countdowns,
+// polling loops and compares). When the second opcode directly follows the first in PRG-ROM, the
+// decode cache runs both through one fused handler. Expanded as
+// PAIR(first opcode, instruction, mode, second opcode, instruction, mode). The first instruction
+// can't be one that writes memory or changes the program counter. A pair ending in a branch branches
+// on the first instruction's result, so the first needs a Result and the branch a TakenOn (see FusedOp).
+#define CPU_6502_FUSED_PAIRS(PAIR) \
+	PAIR(0xA9, LDA, IMM, 0x85, STA, ZP) PAIR(0xA9, LDA, IMM, 0x8D, STA, ABS) PAIR(0xA5, LDA, ZP, 0x85, STA, ZP) \
+	PAIR(0xA5, LDA, ZP, 0x8D, STA, ABS) PAIR(0xAD, LDA, ABS, 0x8D, STA, ABS) PAIR(0xBD, LDA, ABX, 0x9D, STA, ABX) \
+	PAIR(0xB9, LDA, ABY, 0x99, STA, ABY) PAIR(0xB1, LDA, IZY, 0x91, STA, IZY) \
+	PAIR(0xCA, DEX, IMP, 0xD0, BNE, REL) PAIR(0x88, DEY, IMP, 0xD0, BNE, REL) \
+	PAIR(0xA5, LDA, ZP, 0xF0, BEQ, REL) PAIR(0xA5, LDA, ZP, 0xD0, BNE, REL) PAIR(0xAD, LDA, ABS, 0x10, BPL, REL) \
+	PAIR(0xC9, CMP, IMM, 0xD0, BNE, REL) PAIR(0xC9, CMP, IMM, 0xF0, BEQ, REL) PAIR(0xC5, CMP, ZP, 0xD0, BNE, REL)
@@ -0,0 +1,914 @@
+#pragma once
+#include "CPU_6502.h"
+#include "Bus.h"
+#include <cstdint>
+
+// Compile-time opcode handlers
+//
+// Every opcode is an Op<Mode, Instruction> instantiation. The addressing mode policy fetches the operand
+// and returns the effective address, and the operation policy is handed that address directly, so no
+// state is passed between the two through the CPU object and the whole handler inlines into one function.
+
+
+// ****************
+// Addressing Modes
+// ****************
+struct CPU_6502::AddressingMode
+{
+	struct ByteOperand		// One operand byte following the opcode
+	{
+		static const uint8_t size = 1;
+		static uint16_t Fetch(CPU_6502& cpu)
+		{
+			return cpu.bus->Read(cpu.pc++);
+		}
+		static uint8_t Load(CPU_6502& cpu, uint16_t address)
+		{
+			return cpu.bus->Read(address);
+		}
+		static void Store(CPU_6502& cpu, uint16_t address, uint8_t data)
+		{
+			cpu.bus->Write(address, data);
+		}
+	};
+
+	struct WordOperand		// Two operand bytes following the opcode (little endian)
+	{
+		static const uint8_t size = 2;
+		static uint16_t Fetch(CPU_6502& cpu)
+		{
+			uint16_t lsb = cpu.bus->Read(cpu.pc++);
+			return lsb | (uint16_t)(cpu.bus->Read(cpu.pc++) << 8);
+		}
+		static uint8_t Load(CPU_6502& cpu, uint16_t address)
+		{
+			return cpu.bus->Read(address);
+		}
+		static void Store(CPU_6502& cpu, uint16_t address, uint8_t data)
+		{
+			cpu.bus->Write(address, data);
+		}
+	};
+
+	struct ZeroPageOperand : ByteOperand	// Operand is a zero page address, which is always RAM
+	{
+		static uint8_t Load(CPU_6502& cpu, uint16_t address)
+		{
+			return cpu.ReadZeroPage((uint8_t)address);
+		}
+		static void Store(CPU_6502& cpu, uint16_t address, uint8_t data)
+		{
+			cpu.WriteZeroPage((uint8_t)address, data);
+		}
+	};
+
+	struct IMP				// Implicit (handled by the Op<IMP, Instruction> specialization)
+	{
+		static const uint8_t size = 0;
+	};
+
+	struct IMM : ByteOperand	// Immediate
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			return operand;		// The 'address' of an immediate operand is the value itself
+		}
+		static uint8_t Load(CPU_6502& cpu, uint16_t address)
+		{
+			return (uint8_t)address;
+		}
+	};
+
+	struct ZP : ZeroPageOperand		// Zero Page
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			return operand;
+		}
+	};
+
+	struct ZPX : ZeroPageOperand	// Zero Page Indexed (X)
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			return (operand + cpu.regX) & 0x00FF;
+		}
+	};
+
+	struct ZPY : ZeroPageOperand	// Zero Page Indexed (Y)
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			return (operand + cpu.regY) & 0x00FF;
+		}
+	};
+
+	struct ABS : WordOperand	// Absolute
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			return operand;
+		}
+	};
+
+	struct ABX : WordOperand	// Absolute Indexed (X)
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			uint16_t address = operand + cpu.regX;
+			pageCrossed = (address & 0xFF00) != (operand & 0xFF00);
+			return address;
+		}
+	};
+
+	struct ABY : WordOperand	// Absolute Indexed (Y)
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			uint16_t address = operand + cpu.regY;
+			pageCrossed = (address & 0xFF00) != (operand & 0xFF00);
+			return address;
+		}
+	};
+
+	struct IZX : ByteOperand	// Indexed Indirect
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			uint8_t pointer = (uint8_t)(operand + cpu.regX);	// Pointer wraps within the zero page
+			uint16_t lsb = cpu.ReadZeroPage(pointer++);
+			return lsb | (uint16_t)(cpu.ReadZeroPage(pointer) << 8);
+		}
+	};
+
+	struct IZY : ByteOperand	// Indirect Indexed
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			uint8_t pointer = (uint8_t)operand;
+			uint16_t lsb = cpu.ReadZeroPage(pointer++);
+			uint16_t base = lsb | (uint16_t)(cpu.ReadZeroPage(pointer) << 8);
+			uint16_t address = base + cpu.regY;
+			pageCrossed = (address & 0xFF00) != (base & 0xFF00);
+			return address;
+		}
+	};
+
+	struct REL : ByteOperand	// Relative
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			uint16_t address = cpu.pc + (int8_t)operand;
+			pageCrossed = (address & 0xFF00) != (cpu.pc & 0xFF00);
+			return address;
+		}
+	};
+
+	struct IND : WordOperand	// Indirect
+	{
+		static uint16_t Address(CPU_6502& cpu, uint16_t operand, bool& pageCrossed)
+		{
+			uint16_t lsb = cpu.bus->Read(operand++);
+			return lsb | (uint16_t)(cpu.bus->Read(operand) << 8);
+		}
+	};
+};
+
+
+// ************
+// Instructions
+// ************
+//
+// Instructions that take an addressing mode implement Execute<Mode>(cpu, address) and read and write their
+// operand with Mode::Load and Mode::Store. Instructions used with the implicit mode implement Implied(cpu)
+// instead. pageCrossPenalty marks instructions that take an extra cycle when the addressing mode crosses a
+// page boundary, and access tells the micro-op core which bus cycles the instruction needs.
+struct CPU_6502::Operation
+{
+	// Kind of memory access an instruction makes through its addressing mode (used by the micro-op core)
+	enum AccessType { ACCESS_NONE, ACCESS_READ, ACCESS_WRITE, ACCESS_READ_MODIFY_WRITE, ACCESS_STACK };
+
+	struct NoPenalty
+	{
+		static const bool pageCrossPenalty = false;
+		static const AccessType access = ACCESS_NONE;
+	};
+
+	struct Penalty
+	{
+		static const bool pageCrossPenalty = true;
+		static const AccessType access = ACCESS_NONE;
+	};
+
+	struct Load
+	{
+		static const bool pageCrossPenalty = true;
+		static const AccessType access = ACCESS_READ;
+	};
+
+	struct Store
+	{
+		static const bool pageCrossPenalty = false;
+		static const AccessType access = ACCESS_WRITE;
+	};
+
+	struct Modify
+	{
+		static const bool pageCrossPenalty = false;
+		static const AccessType access = ACCESS_READ_MODIFY_WRITE;
+	};
+
+	struct Stack
+	{
+		static const bool pageCrossPenalty = false;
+		static const AccessType access = ACCESS_STACK;
+	};
+
+	// Logical and Arithmetic Commands
+	struct ORA : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.regA |= Mode::Load(cpu, address);
+			cpu.SetNZ(cpu.regA);
+		}
+	};
+	struct AND : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.regA &= Mode::Load(cpu, address);
+			cpu.SetNZ(cpu.regA);
+		}
+	};
+	struct EOR : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.regA ^= Mode::Load(cpu, address);
+			cpu.SetNZ(cpu.regA);
+		}
+	};
+	struct ADC : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.AddCarry(Mode::Load(cpu, address));
+		}
+	};
+	struct SBC : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.AddCarry(Mode::Load(cpu, address) ^ 0xFF);		// Subtract is add of the complement, carry is the inverted borrow
+		}
+	};
+	struct CMP : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.Compare(cpu.regA, Mode::Load(cpu, address));
+		}
+		template<class Mode> static uint8_t Result(CPU_6502& cpu, uint16_t address)
+		{
+			return cpu.Compare(cpu.regA, Mode::Load(cpu, address));
+		}
+	};
+	struct CPX : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.Compare(cpu.regX, Mode::Load(cpu, address));
+		}
+		template<class Mode> static uint8_t Result(CPU_6502& cpu, uint16_t address)
+		{
+			return cpu.Compare(cpu.regX, Mode::Load(cpu, address));
+		}
+	};
+	struct CPY : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.Compare(cpu.regY, Mode::Load(cpu, address));
+		}
+		template<class Mode> static uint8_t Result(CPU_6502& cpu, uint16_t address)
+		{
+			return cpu.Compare(cpu.regY, Mode::Load(cpu, address));
+		}
+	};
+	struct DEC : Modify
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			Mode::Store(cpu, address, cpu.Decrement(Mode::Load(cpu, address)));
+		}
+	};
+	struct DEX : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regX = cpu.Decrement(cpu.regX);
+		}
+		static uint8_t Result(CPU_6502& cpu)
+		{
+			Implied(cpu);
+			return cpu.regX;
+		}
+	};
+	struct DEY : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regY = cpu.Decrement(cpu.regY);
+		}
+		static uint8_t Result(CPU_6502& cpu)
+		{
+			Implied(cpu);
+			return cpu.regY;
+		}
+	};
+	struct INC : Modify
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			Mode::Store(cpu, address, cpu.Increment(Mode::Load(cpu, address)));
+		}
+	};
+	struct INX : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regX = cpu.Increment(cpu.regX);
+		}
+		static uint8_t Result(CPU_6502& cpu)
+		{
+			Implied(cpu);
+			return cpu.regX;
+		}
+	};
+	struct INY : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regY = cpu.Increment(cpu.regY);
+		}
+		static uint8_t Result(CPU_6502& cpu)
+		{
+			Implied(cpu);
+			return cpu.regY;
+		}
+	};
+
+	// Shifts and rotates have separate accumulator (Implied) and memory (Execute) variants
+	struct ASL : Modify
+	{
+		static uint8_t Shift(CPU_6502& cpu, uint8_t data)
+		{
+			cpu.SetC(data & 0x80);
+			data = data << 1;
+			cpu.SetNZ(data);
+			return data;
+		}
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regA = Shift(cpu, cpu.regA);
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			Mode::Store(cpu, address, Shift(cpu, Mode::Load(cpu, address)));
+		}
+	};
+	struct ROL : Modify
+	{
+		static uint8_t Shift(CPU_6502& cpu, uint8_t data)
+		{
+			uint8_t c = cpu.GetC();
+			cpu.SetC(data & 0x80);
+			data = (data << 1) | c;
+			cpu.SetNZ(data);
+			return data;
+		}
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regA = Shift(cpu, cpu.regA);
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			Mode::Store(cpu, address, Shift(cpu, Mode::Load(cpu, address)));
+		}
+	};
+	struct LSR : Modify
+	{
+		static uint8_t Shift(CPU_6502& cpu, uint8_t data)
+		{
+			cpu.SetC(data & 0x01);
+			data = data >> 1;
+			cpu.SetNZ(data);
+			return data;
+		}
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regA = Shift(cpu, cpu.regA);
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			Mode::Store(cpu, address, Shift(cpu, Mode::Load(cpu, address)));
+		}
+	};
+	struct ROR : Modify
+	{
+		static uint8_t Shift(CPU_6502& cpu, uint8_t data)
+		{
+			uint8_t c = cpu.GetC() << 7;
+			cpu.SetC(data & 0x01);
+			data = (data >> 1) | c;
+			cpu.SetNZ(data);
+			return data;
+		}
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regA = Shift(cpu, cpu.regA);
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			Mode::Store(cpu, address, Shift(cpu, Mode::Load(cpu, address)));
+		}
+	};
+
+	// Move Commands
+	struct LDA : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.regA = Mode::Load(cpu, address);
+			cpu.SetNZ(cpu.regA);
+		}
+		template<class Mode> static uint8_t Result(CPU_6502& cpu, uint16_t address)
+		{
+			Execute<Mode>(cpu, address);
+			return cpu.regA;
+		}
+	};
+	struct STA : Store
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			Mode::Store(cpu, address, cpu.regA);
+		}
+	};
+	struct LDX : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.regX = Mode::Load(cpu, address);
+			cpu.SetNZ(cpu.regX);
+		}
+		template<class Mode> static uint8_t Result(CPU_6502& cpu, uint16_t address)
+		{
+			Execute<Mode>(cpu, address);
+			return cpu.regX;
+		}
+	};
+	struct STX : Store
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			Mode::Store(cpu, address, cpu.regX);
+		}
+	};
+	struct LDY : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.regY = Mode::Load(cpu, address);
+			cpu.SetNZ(cpu.regY);
+		}
+		template<class Mode> static uint8_t Result(CPU_6502& cpu, uint16_t address)
+		{
+			Execute<Mode>(cpu, address);
+			return cpu.regY;
+		}
+	};
+	struct STY : Store
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			Mode::Store(cpu, address, cpu.regY);
+		}
+	};
+	struct TAX : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regX = cpu.regA;
+			cpu.SetNZ(cpu.regX);
+		}
+	};
+	struct TXA : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regA = cpu.regX;
+			cpu.SetNZ(cpu.regA);
+		}
+	};
+	struct TAY : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regY = cpu.regA;
+			cpu.SetNZ(cpu.regY);
+		}
+	};
+	struct TYA : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regA = cpu.regY;
+			cpu.SetNZ(cpu.regA);
+		}
+	};
+	struct TSX : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regX = cpu.sp;
+			cpu.SetNZ(cpu.regX);
+		}
+	};
+	struct TXS : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.sp = cpu.regX;
+		}
+	};
+	struct PLA : Stack
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.regA = cpu.Pull();
+			cpu.SetNZ(cpu.regA);
+		}
+	};
+	struct PHA : Stack
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.Push(cpu.regA);
+		}
+	};
+	struct PLP : Stack
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.DelayInterruptMask();
+			cpu.UnpackStatus(cpu.Pull());
+		}
+	};
+	struct PHP : Stack
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.status.B = 0x11;
+			cpu.Push(cpu.PackStatus());
+		}
+	};
+
+	// Jump/Flag Commands
+	struct BPL : Penalty
+	{
+		static bool Taken(CPU_6502& cpu)
+		{
+			return !cpu.GetN();
+		}
+		static bool TakenOn(uint8_t result)		// Same test on the value the flags were set from
+		{
+			return !(result & 0x80);
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			if (Taken(cpu))
+				cpu.pc = address;
+		}
+	};
+	struct BMI : Penalty
+	{
+		static bool Taken(CPU_6502& cpu)
+		{
+			return cpu.GetN();
+		}
+		static bool TakenOn(uint8_t result)		// Same test on the value the flags were set from
+		{
+			return (result & 0x80) != 0;
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			if (Taken(cpu))
+				cpu.pc = address;
+		}
+	};
+	struct BVC : Penalty
+	{
+		static bool Taken(CPU_6502& cpu)
+		{
+			return !cpu.GetV();
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			if (Taken(cpu))
+				cpu.pc = address;
+		}
+	};
+	struct BVS : Penalty
+	{
+		static bool Taken(CPU_6502& cpu)
+		{
+			return cpu.GetV();
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			if (Taken(cpu))
+				cpu.pc = address;
+		}
+	};
+	struct BCC : Penalty
+	{
+		static bool Taken(CPU_6502& cpu)
+		{
+			return !cpu.GetC();
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			if (Taken(cpu))
+				cpu.pc = address;
+		}
+	};
+	struct BCS : Penalty
+	{
+		static bool Taken(CPU_6502& cpu)
+		{
+			return cpu.GetC();
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			if (Taken(cpu))
+				cpu.pc = address;
+		}
+	};
+	struct BNE : Penalty
+	{
+		static bool Taken(CPU_6502& cpu)
+		{
+			return !cpu.GetZ();
+		}
+		static bool TakenOn(uint8_t result)		// Same test on the value the flags were set from
+		{
+			return result != 0;
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			if (Taken(cpu))
+				cpu.pc = address;
+		}
+	};
+	struct BEQ : Penalty
+	{
+		static bool Taken(CPU_6502& cpu)
+		{
+			return cpu.GetZ();
+		}
+		static bool TakenOn(uint8_t result)		// Same test on the value the flags were set from
+		{
+			return result == 0;
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			if (Taken(cpu))
+				cpu.pc = address;
+		}
+	};
+	struct BRK : Stack
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.status.B = 0x11;
+			cpu.Push((cpu.pc & 0xFF00) >> 8);
+			cpu.Push(cpu.pc & 0x00FF);
+			cpu.Push(cpu.PackStatus());
+			uint16_t lsb = cpu.bus->Read(0xFFFE);
+			cpu.pc = lsb | (uint16_t)(cpu.bus->Read(0xFFFF) << 8);
+			cpu.status.I = 1;
+		}
+	};
+	struct RTI : Stack
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.UnpackStatus(cpu.Pull());
+			uint16_t lsb = cpu.Pull();
+			cpu.pc = lsb | (uint16_t)(cpu.Pull() << 8);
+		}
+	};
+	struct JSR : Stack
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.Push((cpu.pc & 0xFF00) >> 8);
+			cpu.Push(cpu.pc & 0x00FF);
+			cpu.pc = address;
+		}
+	};
+	struct RTS : Stack
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			uint16_t lsb = cpu.Pull();
+			cpu.pc = lsb | (uint16_t)(cpu.Pull() << 8);
+		}
+	};
+	struct JMP : NoPenalty
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			cpu.pc = address;
+		}
+	};
+	struct BIT : Load
+	{
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+			uint8_t data = Mode::Load(cpu, address);
+			cpu.SetN(data & 0x80);
+			cpu.SetV(data & 0x40);
+			cpu.SetZ((data & cpu.regA) == 0);
+		}
+	};
+	struct CLC : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.SetC(0);
+		}
+	};
+	struct SEC : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.SetC(1);
+		}
+	};
+	struct CLD : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.SetD(0);
+		}
+	};
+	struct SED : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.SetD(1);
+		}
+	};
+	struct CLI : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.DelayInterruptMask();
+			cpu.SetI(0);
+		}
+	};
+	struct SEI : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.DelayInterruptMask();
+			cpu.SetI(1);
+		}
+	};
+	struct CLV : NoPenalty
+	{
+		static void Implied(CPU_6502& cpu)
+		{
+			cpu.SetV(0);
+		}
+	};
+	struct NOP : NoPenalty
+	{
+		static const AccessType access = ACCESS_READ;
+		static void Implied(CPU_6502& cpu)
+		{
+		}
+		template<class Mode> static void Execute(CPU_6502& cpu, uint16_t address)
+		{
+		}
+	};
+
+	// Illegal Opcodes (not implemented yet, these execute as NOPs)
+	struct SLO : NOP { static const AccessType access = ACCESS_READ_MODIFY_WRITE; };
+	struct RLA : NOP { static const AccessType access = ACCESS_READ_MODIFY_WRITE; };
+	struct SRE : NOP { static const AccessType access = ACCESS_READ_MODIFY_WRITE; };
+	struct RRA : NOP { static const AccessType access = ACCESS_READ_MODIFY_WRITE; };
+	struct SAX : NOP { static const AccessType access = ACCESS_WRITE; };
+	struct LAX : NOP {};
+	struct DCP : NOP { static const AccessType access = ACCESS_READ_MODIFY_WRITE; };
+	struct ISC : NOP { static const AccessType access = ACCESS_READ_MODIFY_WRITE; };
+	struct ANC : NOP {};
+	struct ALR : NOP {};
+	struct ARR : NOP {};
+	struct XAA : NOP {};
+	struct AXS : NOP {};
+	struct AHX : NOP { static const AccessType access = ACCESS_WRITE; };
+	struct SHY : NOP { static const AccessType access = ACCESS_WRITE; };
+	struct SHX : NOP { static const AccessType access = ACCESS_WRITE; };
+	struct TAS : NOP { static const AccessType access = ACCESS_WRITE; };
+	struct LAS : NOP {};
+	struct KIL : NOP {};
+};
+
+
+// ***************
+// Opcode Handlers
+// ***************
+//
+// Execute() fetches the operand from the instruction stream, Run() takes an already fetched operand.
+// Both return the number of extra cycles taken on top of the opcode's base cycles.
+template<class Mode, class Instruction>
+struct CPU_6502::Op
+{
+	static uint8_t Execute(CPU_6502& cpu)
+	{
+		return Run(cpu, Mode::Fetch(cpu));
+	}
+
+	static uint8_t Run(CPU_6502& cpu, uint16_t operand)
+	{
+		bool pageCrossed = false;
+		uint16_t address = Mode::Address(cpu, operand, pageCrossed);
+		Instruction::template Execute<Mode>(cpu, address);
+		return Instruction::pageCrossPenalty && pageCrossed ? 1 : 0;
+	}
+
+	// Run() for instructions with a Result, also hands back the value N and Z were set from
+	static uint8_t Result(CPU_6502& cpu, uint16_t operand, uint8_t& cycles)
+	{
+		bool pageCrossed = false;
+		uint16_t address = Mode::Address(cpu, operand, pageCrossed);
+		cycles = Instruction::pageCrossPenalty && pageCrossed ? 1 : 0;
+		return Instruction::template Result<Mode>(cpu, address);
+	}
+};
+
+template<class Instruction>
+struct CPU_6502::Op<CPU_6502::AddressingMode::IMP, Instruction>
+{
+	static uint8_t Execute(CPU_6502& cpu)
+	{
+		Instruction::Implied(cpu);
+		return 0;
+	}
+
+	static uint8_t Run(CPU_6502& cpu, uint16_t operand)
+	{
+		Instruction::Implied(cpu);
+		return 0;
+	}
+
+	static uint8_t Result(CPU_6502& cpu, uint16_t, uint8_t& cycles)
+	{
+		cycles = 0;
+		return Instruction::Result(cpu);
+	}
+};
+
+// Superinstruction: two handlers inlined into one, so the pair costs a single dispatch.
+// Returns the extra cycles of both.
+template<class First, class Second>
+struct CPU_6502::FusedOp
+{
+	static uint8_t Run(CPU_6502& cpu, uint16_t first, uint16_t second)
+	{
+		uint8_t cycles = First::Run(cpu, first);
+		return cycles + Second::Run(cpu, second);
+	}
+};
+
+// A branch on N or Z after an instruction that sets them tests the first instruction's result directly,
+// so the flags are only written once and never read back. The first instruction needs a Result and the
+// branch a TakenOn. pc is already past both instructions, where the branch offset counts from.
+template<class First, class Branch>
+struct CPU_6502::FusedOp<First, CPU_6502::Op<CPU_6502::AddressingMode::REL, Branch>>
+{
+	static uint8_t Run(CPU_6502& cpu, uint16_t first, uint16_t second)
+	{
+		uint8_t cycles;
+		uint8_t result = First::Result(cpu, first, cycles);
+		bool pageCrossed = false;
+		uint16_t address = AddressingMode::REL::Address(cpu, second, pageCrossed);
+		if (Branch::TakenOn(result))
+			cpu.pc = address;
+		return cycles + (Branch::pageCrossPenalty && pageCrossed ? 1 : 0);
+	}
+};
@@ -0,0 +1,310 @@
+#include "CPU_6502.h"
+#include "CPU_6502_Ops.h"
+#include "CPU_6502_Recompiler.h"
+#include "Bus.h"
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef CPU_RECOMPILER
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+CPU_6502::Recompiler::Recompiler(CPU_6502& cpu, bool checked) : cpu(cpu), checked(checked)
+{
+#ifdef _WIN32
+	code = (uint8_t*)VirtualAlloc(NULL, CODE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void* memory = mmap(NULL, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	code = memory == MAP_FAILED ? NULL : (uint8_t*)memory;
+#endif
+	if (!code)
+		throw std::runtime_error("Unable to allocate executable memory");
+	codeUsed = 0;
+
+	Block empty = { NULL, 0, 0, 0 };	// Generation 0 marks every entry as not compiled yet
+	blocks.assign(0x8000, empty);
+	if (checked)
+	{
+		ramBefore.resize(0x2000);
+		ramAfter.resize(0x2000);
+	}
+}
+
+CPU_6502::Recompiler::~Recompiler()
+{
+#ifdef _WIN32
+	VirtualFree(code, 0, MEM_RELEASE);
+#else
+	munmap(code, CODE_BUFFER_SIZE);
+#endif
+}
+
+uint32_t CPU_6502::Recompiler::Run(uint16_t& lastInstruction)
+{
+	if (!(cpu.pc & 0x8000) || cpu.interruptLines)
+		return 0;
+
+	Block& block = blocks[cpu.pc & 0x7FFF];
+	if (block.generation != cpu.bus->GetGeneration(cpu.pc))
+		Compile(block, cpu.pc);
+	if (!block.function)
+		return 0;
+
+	lastInstruction = block.lastInstruction;
+	if (checked)
+		return RunChecked(block);
+	return block.function(&cpu);
+}
+
+uint32_t CPU_6502::Recompiler::RunChecked(const Block& block)
+{
+	// Blocks can only change the registers and the RAM below $2000, so save those, run the block,
+	// then put them back and run the same instructions on the interpreter
+	uint16_t pc = cpu.pc;
+	uint8_t a = cpu.regA, x = cpu.regX, y = cpu.regY, sp = cpu.sp, p = cpu.PackStatus();
+	for (uint16_t i = 0; i < 0x2000; i++)
+		ramBefore[i] = cpu.bus->Peek(i);
+
+	uint32_t cycles = block.function(&cpu);
+	uint16_t pcAfter = cpu.pc;
+	uint8_t aAfter = cpu.regA, xAfter = cpu.regX, yAfter = cpu.regY, spAfter = cpu.sp, pAfter = cpu.PackStatus();
+	for (uint16_t i = 0; i < 0x2000; i++)
+		ramAfter[i] = cpu.bus->Peek(i);
+	for (uint16_t i = 0; i < 0x2000; i++)		// Separate pass, the RAM may be mirrored
+	{
+		if (ramAfter[i] != ramBefore[i])
+			cpu.bus->Write(i, ramBefore[i]);
+	}
+
+	cpu.pc = pc;
+	cpu.regA = a;
+	cpu.regX = x;
+	cpu.regY = y;
+	cpu.sp = sp;
+	cpu.UnpackStatus(p);
+	uint32_t interpretedCycles = 0;
+	for (int i = 0; i < block.instructions; i++)
+		interpretedCycles += cpu.RunInstruction();
+
+	bool match = cycles == interpretedCycles && cpu.pc == pcAfter && cpu.regA == aAfter && cpu.regX == xAfter &&
+		cpu.regY == yAfter && cpu.sp == spAfter && cpu.PackStatus() == pAfter;
+	for (uint16_t i = 0; match && i < 0x2000; i++)
+		match = cpu.bus->Peek(i) == ramAfter[i];
+	if (!match)
+		throw std::logic_error("Recompiled block does not match the interpreter");
+	return interpretedCycles;
+}
+
+void CPU_6502::Recompiler::Compile(Block& block, uint16_t start)
+{
+	block.generation = cpu.bus->TrackGeneration(start);
+	block.function = NULL;
+
+	// Collect the instructions of the block
+	Instruction instructions[MAX_BLOCK_INSTRUCTIONS];
+	uint8_t count = 0;
+	uint32_t cycles = 0;
+	uint16_t address = start;
+	while (count < MAX_BLOCK_INSTRUCTIONS)
+	{
+		Instruction& instruction = instructions[count];
+		instruction.address = address;
+		if (!cpu.FetchCached(address, start, instruction.opCode, instruction.operand))
+			break;		// Breakpoints are left to the decode cache trap
+		if (!CanRecompile(instruction.opCode, instruction.operand))
+			break;
+
+		const OpCode& opCode = opCodes[instruction.opCode];
+		count++;
+		cycles += opCode.cycles;
+		address += 1 + opCode.size;
+		if (EndsBlock(instruction.opCode))
+			break;
+	}
+	if (count == 0)
+		return;
+
+	if (codeUsed + MAX_BLOCK_CODE > CODE_BUFFER_SIZE)
+	{
+		// Out of room, start over with an empty buffer
+		for (size_t i = 0; i < blocks.size(); i++)
+			blocks[i].generation = 0;
+		block.generation = cpu.bus->TrackGeneration(start);
+		codeUsed = 0;
+	}
+	BlockFunction function = (BlockFunction)(code + codeUsed);
+
+	// Prologue: keep the cpu in rbx and the extra cycles in r12, both callee saved on either ABI. The
+	// 40 bytes keep the stack 16 byte aligned for calls and double as the Win64 shadow space.
+	Emit(0x53);							// push rbx
+	Emit(0x41); Emit(0x54);				// push r12
+	Emit(0x48); Emit(0x83); Emit(0xEC); Emit(0x28);	// sub rsp, 40
+#ifdef _WIN32
+	Emit(0x48); Emit(0x89); Emit(0xCB);	// mov rbx, rcx
+#else
+	Emit(0x48); Emit(0x89); Emit(0xFB);	// mov rbx, rdi
+#endif
+	Emit(0x45); Emit(0x31); Emit(0xE4);	// xor r12d, r12d
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		const Instruction& instruction = instructions[i];
+		if (i == count - 1)
+		{
+			// Only the last instruction can look at pc, the others never need it updated
+			Emit(0x66); Emit(0xC7); EmitModRM(0, &cpu.pc);	// mov word [rbx + pc], next instruction
+			Emit16(instruction.address + 1 + opCodes[instruction.opCode].size);
+		}
+		if (!EmitNative(instruction.opCode, instruction.operand))
+			EmitCall(instruction);
+	}
+
+	// Epilogue: return the base cycles plus whatever the handlers added
+	Emit(0x44); Emit(0x89); Emit(0xE0);	// mov eax, r12d
+	Emit(0x05); Emit32(cycles);			// add eax, cycles
+	Emit(0x48); Emit(0x83); Emit(0xC4); Emit(0x28);	// add rsp, 40
+	Emit(0x41); Emit(0x5C);				// pop r12
+	Emit(0x5B);							// pop rbx
+	Emit(0xC3);							// ret
+
+	block.function = function;
+	block.lastInstruction = instructions[count - 1].address;
+	block.instructions = count;
+}
+
+bool CPU_6502::Recompiler::CanRecompile(uint8_t opCode, uint16_t operand) const
+{
+	// Every address the instruction can reach has to be RAM, or PRG-ROM that is only read
+	uint32_t first, last;
+	switch (opCodeInfo[opCode].mode)
+	{
+	case MODE_IZX:
+	case MODE_IZY:
+		return false;		// Address isn't known until the pointer is read
+	case MODE_ABS:
+		if (accessTypes[opCode] == Operation::ACCESS_NONE || accessTypes[opCode] == Operation::ACCESS_STACK)
+			return true;	// JMP and JSR, the operand is only a destination
+		first = last = operand;
+		break;
+	case MODE_ABX:
+	case MODE_ABY:
+		first = operand;
+		last = operand + 0xFF;
+		break;
+	case MODE_IND:
+		return operand < 0x1FFF || (operand >= 0x8000 && operand != 0xFFFF);
+	default:
+		return true;		// Registers, zero page and stack only
+	}
+	if (last < 0x2000)
+		return true;
+	return first >= 0x8000 && last <= 0xFFFF && accessTypes[opCode] == Operation::ACCESS_READ;
+}
+
+bool CPU_6502::Recompiler::EmitNative(uint8_t opCode, uint16_t operand)
+{
+#ifdef CPU_LAZY_FLAGS
+	// Register loads, transfers and steps that set N and Z from the result
+	uint8_t* target;
+	uint8_t* source = NULL;
+	uint8_t step = 0;		// ModRM of inc al / dec al
+	switch (opCode)
+	{
+	case 0xA9: target = &cpu.regA; break;	// LDA #
+	case 0xA2: target = &cpu.regX; break;	// LDX #
+	case 0xA0: target = &cpu.regY; break;	// LDY #
+	case 0xAA: target = &cpu.regX; source = &cpu.regA; break;	// TAX
+	case 0xA8: target = &cpu.regY; source = &cpu.regA; break;	// TAY
+	case 0x8A: target = &cpu.regA; source = &cpu.regX; break;	// TXA
+	case 0x98: target = &cpu.regA; source = &cpu.regY; break;	// TYA
+	case 0xE8: target = source = &cpu.regX; step = 0xC0; break;	// INX
+	case 0xC8: target = source = &cpu.regY; step = 0xC0; break;	// INY
+	case 0xCA: target = source = &cpu.regX; step = 0xC8; break;	// DEX
+	case 0x88: target = source = &cpu.regY; step = 0xC8; break;	// DEY
+	case 0x18:	// CLC
+	case 0x38:	// SEC
+		Emit(0xC6); EmitModRM(0, &cpu.flagC); Emit(opCode == 0x38);	// mov byte [rbx + flagC], imm8
+		return true;
+	case 0xEA:	// NOP
+		return true;
+	default:
+		return false;
+	}
+
+	if (source)
+	{
+		Emit(0x8A); EmitModRM(0, source);		// mov al, [rbx + source]
+		if (step)
+		{
+			Emit(0xFE); Emit(step);				// inc al / dec al
+		}
+	}
+	else
+	{
+		Emit(0xB0); Emit((uint8_t)operand);		// mov al, imm8
+	}
+	Emit(0x88); EmitModRM(0, target);			// mov [rbx + target], al
+	Emit(0x88); EmitModRM(0, &cpu.flagN);		// mov [rbx + flagN], al
+	Emit(0x88); EmitModRM(0, &cpu.flagZ);		// mov [rbx + flagZ], al
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CPU_6502::Recompiler::EmitCall(const Instruction& instruction)
+{
+	const OpCode& opCode = opCodes[instruction.opCode];
+#ifdef _WIN32
+	Emit(0x48); Emit(0x89); Emit(0xD9);		// mov rcx, rbx
+	Emit(0xBA); Emit32(instruction.operand);	// mov edx, operand
+#else
+	Emit(0x48); Emit(0x89); Emit(0xDF);		// mov rdi, rbx
+	Emit(0xBE); Emit32(instruction.operand);	// mov esi, operand
+#endif
+	Emit(0x48); Emit(0xB8); Emit64((uint64_t)opCode.run);	// mov rax, handler
+	Emit(0xFF); Emit(0xD0);					// call rax
+
+	// Only indexed and relative addressing can add a page crossing cycle
+	ModeIndex mode = opCodeInfo[instruction.opCode].mode;
+	if (mode == MODE_ABX || mode == MODE_ABY || mode == MODE_REL)
+	{
+		Emit(0x0F); Emit(0xB6); Emit(0xC0);		// movzx eax, al
+		Emit(0x41); Emit(0x01); Emit(0xC4);		// add r12d, eax
+	}
+}
+
+void CPU_6502::Recompiler::Emit(uint8_t byte)
+{
+	code[codeUsed++] = byte;
+}
+
+void CPU_6502::Recompiler::Emit16(uint16_t data)
+{
+	Emit(data & 0xFF);
+	Emit(data >> 8);
+}
+
+void CPU_6502::Recompiler::Emit32(uint32_t data)
+{
+	Emit16(data & 0xFFFF);
+	Emit16(data >> 16);
+}
+
+void CPU_6502::Recompiler::Emit64(uint64_t data)
+{
+	Emit32(data & 0xFFFFFFFF);
+	Emit32(data >> 32);
+}
+
+void CPU_6502::Recompiler::EmitModRM(uint8_t reg, const void* member)
+{
+	Emit(0x83 | (reg << 3));	// [rbx + disp32]
+	Emit32((uint32_t)((const uint8_t*)member - (const uint8_t*)&cpu));
+}
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+#include "CPU_6502.h"
+#include <cstdint>
+#include <vector>
+
+#ifdef CPU_RECOMPILER
+
+// Basic block recompiler (x86-64)
+//
+// Straight runs of PRG-ROM instructions are translated into native functions that call the same
+// Op<Mode, Instruction>::Run handlers the interpreter uses, with the operands baked in, so a block runs
+// without any fetching, decoding or dispatch. Simple register instructions are written out natively.
+// A block ends after any instruction that changes the program counter, and stops short of instructions
+// that could touch anything but RAM or read PRG-ROM (I/O, mapper writes, indirect addressing), which
+// are left to the interpreter. Blocks are checked against the bus generation of the 4k block they
+// were compiled from, so a bank switch or a write into PRG space throws them away. Code in RAM is
+// never recompiled.
+class CPU_6502::Recompiler
+{
+public:
+	Recompiler(CPU_6502& cpu, bool checked);
+	~Recompiler();
+
+	uint32_t Run(uint16_t& lastInstruction);	// Runs the block at pc, returns cycles taken or 0 if there isn't one
+
+private:
+	typedef uint32_t (*BlockFunction)(CPU_6502* cpu);
+
+	struct Block
+	{
+		BlockFunction function;		// NULL if the first instruction can't be recompiled
+		uint32_t generation;		// Bus generation of the block the code was compiled from
+		uint16_t lastInstruction;
+		uint8_t instructions;
+	};
+
+	struct Instruction
+	{
+		uint16_t address;
+		uint8_t opCode;
+		uint16_t operand;
+	};
+
+	static const uint8_t MAX_BLOCK_INSTRUCTIONS = 32;
+	static const size_t CODE_BUFFER_SIZE = 4 * 1024 * 1024;
+	static const size_t MAX_BLOCK_CODE = 64 + MAX_BLOCK_INSTRUCTIONS * 48;
+
+	CPU_6502& cpu;
+	bool checked;
+	std::vector<Block> blocks;		// One entry per PRG-ROM address
+	uint8_t* code;
+	size_t codeUsed;
+	std::vector<uint8_t> ramBefore;	// Checked mode snapshots
+	std::vector<uint8_t> ramAfter;
+
+	void Compile(Block& block, uint16_t address);
+	bool CanRecompile(uint8_t opCode, uint16_t operand) const;
+	bool EmitNative(uint8_t opCode, uint16_t operand);
+	void EmitCall(const Instruction& instruction);
+	uint32_t RunChecked(const Block& block);
+
+	// x86-64 encoding
+	void Emit(uint8_t byte);
+	void Emit16(uint16_t data);
+	void Emit32(uint32_t data);
+	void Emit64(uint64_t data);
+	void EmitModRM(uint8_t reg, const void* member);		// reg, [rbx + offset of member]
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "CPU_6502.h"
+#include "CPU_6502_Ops.h"
+#include "CPU_6502_Threaded.h"
+#include "Bus.h"
+#include <cstdint>
+
+#ifdef CPU_THREADED_CODE
+
+#define THREADED_HANDLER(code, instruction, mode, cycles) \
+	&CPU_6502::ThreadedCode::Execute<CPU_6502::AddressingMode::mode, CPU_6502::Operation::instruction>,
+const CPU_6502::ThreadedCode::Handler CPU_6502::ThreadedCode::handlers[0x100] = {
+	CPU_6502_OPCODES(THREADED_HANDLER)
+};
+#undef THREADED_HANDLER
+
+CPU_6502::ThreadedCode::ThreadedCode(CPU_6502& cpu) : cpu(cpu)
+{
+	Thread empty = { 0, 0, 0 };		// Generation 0 marks every entry as not built yet
+	threads.assign(0x8000, empty);
+}
+
+template<class Mode, class Instruction>
+uint32_t CPU_6502::ThreadedCode::Execute(CPU_6502& cpu, const ThreadedOp* op, uint32_t cycles)
+{
+	cpu.pc = op->next;
+	cycles += op->cycles + Op<Mode, Instruction>::Run(cpu, op->operand);
+#ifdef CPU_THREADED_MUSTTAIL
+	[[clang::musttail]] return op[1].handler(cpu, op + 1, cycles);
+#else
+	return cycles;
+#endif
+}
+
+uint32_t CPU_6502::ThreadedCode::Exit(CPU_6502&, const ThreadedOp*, uint32_t cycles)
+{
+	return cycles;
+}
+
+uint32_t CPU_6502::ThreadedCode::Run(uint16_t& lastInstruction)
+{
+	if (!(cpu.pc & 0x8000) || cpu.interruptLines)
+		return 0;
+
+	Thread& thread = threads[cpu.pc & 0x7FFF];
+	if (thread.generation != cpu.bus->GetGeneration(cpu.pc))
+		Build(thread, cpu.pc);
+
+	const ThreadedOp* op = &pool[thread.first];
+	if (op->handler == &Exit)
+		return 0;		// First instruction straddles two blocks
+	lastInstruction = thread.lastInstruction;
+#ifdef CPU_THREADED_MUSTTAIL
+	return op->handler(cpu, op, 0);
+#else
+	uint32_t cycles = 0;
+	for (; op->handler != &Exit; op++)
+		cycles = op->handler(cpu, op, cycles);
+	return cycles;
+#endif
+}
+
+void CPU_6502::ThreadedCode::Build(Thread& thread, uint16_t start)
+{
+	if (pool.size() + MAX_THREAD_INSTRUCTIONS + 1 > MAX_POOL_SIZE)
+	{
+		// Out of room, start over with an empty pool
+		pool.clear();
+		for (Thread& t : threads)
+			t.generation = 0;
+	}
+
+	thread.generation = cpu.bus->TrackGeneration(start);
+	thread.first = (uint32_t)pool.size();
+
+	uint16_t address = start;
+	for (uint8_t count = 0; count < MAX_THREAD_INSTRUCTIONS; count++)
+	{
+		uint8_t opCode;
+		ThreadedOp op;
+		if (!cpu.FetchCached(address, start, opCode, op.operand))
+			break;		// Breakpoints are left to the decode cache trap
+
+		const OpCode& info = opCodes[opCode];
+		op.handler = handlers[opCode];
+		op.next = address + 1 + info.size;
+		op.cycles = info.cycles;
+		pool.push_back(op);
+
+		thread.lastInstruction = address;
+		address = op.next;
+		if (EndsBlock(opCode) || MayWriteOutsideRAM(opCode, op.operand))
+			break;
+	}
+
+	ThreadedOp exit = { &Exit, 0, 0, 0 };
+	pool.push_back(exit);
+}
+
+bool CPU_6502::ThreadedCode::MayWriteOutsideRAM(uint8_t opCode, uint16_t operand)
+{
+	if (accessTypes[opCode] != Operation::ACCESS_WRITE && accessTypes[opCode] != Operation::ACCESS_READ_MODIFY_WRITE)
+		return false;
+	switch (opCodeInfo[opCode].mode)
+	{
+	case MODE_ABS:
+		return operand >= 0x2000;
+	case MODE_ABX:
+	case MODE_ABY:
+		return operand + 0xFF >= 0x2000;
+	case MODE_IZX:
+	case MODE_IZY:
+		return true;		// Address isn't known until the pointer is read
+	default:
+		return false;		// Registers, zero page and stack only
+	}
+}
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+#include "CPU_6502.h"
+#include <cstdint>
+#include <vector>
+
+#ifdef CPU_THREADED_CODE
+
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define CPU_THREADED_MUSTTAIL	// Handlers jump straight to the next one instead of returning to a loop
+#endif
+#endif
+
+// Direct threaded code
+//
+// The portable counterpart of the recompiler: straight runs of PRG-ROM instructions are translated into
+// arrays of handler pointers with the operands already fetched. Every handler is its own Op<Mode, Instruction>
+// instantiation and ends by calling the handler of the next instruction, so the dispatch jump is spread
+// over as many indirect branches as there are handlers, each with its own prediction history. A thread ends
+// after any instruction that changes the program counter or might write outside RAM, so a bank switch is
+// seen before the next thread starts. Threads are checked against the bus generation of the 4k block they
+// were built from. Code in RAM is left to the interpreter.
+class CPU_6502::ThreadedCode
+{
+public:
+	ThreadedCode(CPU_6502& cpu);
+
+	uint32_t Run(uint16_t& lastInstruction);	// Runs the thread at pc, returns cycles taken or 0 if there isn't one
+
+private:
+	struct ThreadedOp;
+	typedef uint32_t (*Handler)(CPU_6502& cpu, const ThreadedOp* op, uint32_t cycles);
+
+	struct ThreadedOp
+	{
+		Handler handler;
+		uint16_t operand;
+		uint16_t next;			// Address of the following instruction
+		uint8_t cycles;			// Base cycles, penalties are added by the handler
+	};
+
+	struct Thread
+	{
+		uint32_t first;			// Index of the first op in the pool
+		uint32_t generation;	// Bus generation of the block the thread was built from, 0 if never built
+		uint16_t lastInstruction;
+	};
+
+	static const uint8_t MAX_THREAD_INSTRUCTIONS = 64;
+	static const size_t MAX_POOL_SIZE = 1024 * 1024;
+
+	static const Handler handlers[0x100];
+
+	CPU_6502& cpu;
+	std::vector<Thread> threads;	// One entry per PRG-ROM address
+	std::vector<ThreadedOp> pool;
+
+	void Build(Thread& thread, uint16_t address);
+	static bool MayWriteOutsideRAM(uint8_t opCode, uint16_t operand);
+
+	template<class Mode, class Instruction>
+	static uint32_t Execute(CPU_6502& cpu, const ThreadedOp* op, uint32_t cycles);
+	static uint32_t Exit(CPU_6502& cpu, const ThreadedOp* op, uint32_t cycles);
+};
+
+#endif
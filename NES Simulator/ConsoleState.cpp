@@ -0,0 +1,43 @@
+#include "ConsoleState.h"
+#include <new>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+ConsoleState* ConsoleState::Create()
+{
+	// Straight from the OS: page aligned, already zeroed, and pages only become resident once touched, so the
+	// ROM banks of a console running from a mapped image cost nothing
+#ifdef _WIN32
+	void* memory = VirtualAlloc(NULL, sizeof(ConsoleState), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void* memory = mmap(NULL, sizeof(ConsoleState), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		memory = NULL;
+#endif
+	if (!memory)
+		throw std::bad_alloc();
+	return new (memory) ConsoleState;
+}
+
+void ConsoleState::Destroy(ConsoleState* state)
+{
+#ifdef _WIN32
+	VirtualFree(state, 0, MEM_RELEASE);
+#else
+	munmap(state, sizeof(ConsoleState));
+#endif
+}
+
+void ConsoleState::Copy(ConsoleState* to, const ConsoleState* from)
+{
+	memcpy(to, from, offsetof(ConsoleState, chrROM));
+	if (from->chrROMUsed)
+		memcpy(to->chrROM, from->chrROM, sizeof(chrROM));
+	if (from->prgROMUsed)
+		memcpy(to->prgROM, from->prgROM, sizeof(prgROM));
+}
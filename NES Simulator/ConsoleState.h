@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Console state arena
+//
+// Everything that makes up a running console sits in one block with a fixed layout, allocated once: the
+// registers of the CPU and PPU, palette and OAM, internal and video RAM, then the cartridge ROM. Memory and
+// the PPU work on it in place and the CPU keeps its registers in it between instructions, so saving a state,
+// rewinding or cloning a console is one Copy of the block. The small, hot state shares the first cache
+// lines and every array starts on a line of its own.
+//
+// A state is copied in or out between instructions: after RunCycles, RunUntil or Step, or once Clock has
+// returned true. The CPU works on copies of its registers and stores them at the end of every run, so after
+// copying a state in call OnStateLoaded on the bus, the PPU and the CPU, in that order. What is left out
+// belongs to the host side and is rebuilt or reset by OnStateLoaded: the bus dirty pages and generations
+// and the PPU dirty pages (everything counts as changed), the CPU decode, threaded and recompiled code and
+// the idle loop it last saw (checked again), and an instruction the CPU was part way through (dropped). The
+// PPU screens aren't part of it either, the next frame draws over them. Breakpoints and watchpoints stay
+// with the console they were set on.
+//
+// The ROM banks stay in the block for consoles that load the cartridge by copying it. There the program can
+// write to them, so they are part of the state. A console running from a mapped image never touches them,
+// and they cost it address space only: Create leaves them non-resident and Copy skips them. A copy of such
+// a console is only complete if both consoles map the same image.
+struct alignas(64) ConsoleState
+{
+	struct CPUState
+	{
+		uint64_t cycles;		// Cycles run since power on
+		uint16_t pc;
+		uint8_t a;
+		uint8_t x;
+		uint8_t y;
+		uint8_t sp;
+		uint8_t p;				// Status register, packed
+		uint16_t interruptLines;	// IRQ sources, latched NMI and delayed I
+		uint16_t stallCycles;		// DMA halt not taken yet
+		bool stallAligned;
+		bool nmiLine;
+		bool delayedI;
+	};
+
+	struct PPUState
+	{
+		int16_t scanline;
+		int16_t cycle;
+		uint8_t registers[8];
+		uint8_t colorData[28];
+		uint16_t vramAddress;	// Where PPUDATA reads and writes
+		bool writeLatch;		// The next PPUSCROLL or PPUADDR write is the second of its pair
+		uint8_t nametableMap;	// PPU::NametableMapType
+	};
+
+	CPUState cpu;
+	PPUState ppu;
+	bool prgROMUsed;		// Program ROM runs from the banks below, not from a mapped image
+	bool chrROMUsed;		// Same for the pattern tables
+	alignas(64) uint8_t oam[0x100];
+	alignas(64) uint8_t ram[0x800];
+	alignas(64) uint8_t videoRAM[0x800];
+	alignas(64) uint8_t videoRAM2[0x800];		// Extra nametables for four-screen mapping
+	alignas(64) uint8_t chrROM[0x4000];
+	alignas(64) uint8_t prgROM[2][0x4000];
+
+	static ConsoleState* Create();				// Zeroed, on a page boundary
+	static void Destroy(ConsoleState* state);
+	static void Copy(ConsoleState* to, const ConsoleState* from);	// Everything, but only the ROM banks in use
+};
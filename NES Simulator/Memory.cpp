@@ -1,26 +1,21 @@
 #include "Memory.h"
+#include <stdexcept>
 
-Memory::Memory() 
+Memory::Memory(ConsoleState* state)
 {
-	ram[3] = ram[2] = ram[1] = ram[0] = new uint8_t[SIZE_2K];	// 2K of internam ram mirrored to other banks
-	if (ram[0])
-	{
-		Initialize(ram[0], SIZE_2K);
-	}
+	if (!state)
+		throw std::invalid_argument("Invalid NULL argument");
 
-	rom[1] = rom[0] = new uint8_t[SIZE_16K];	// Lower 16k of ROM memory (default is mirrored)
-	if (rom[0])
-	{
-		Initialize(rom[0], SIZE_16K);
-	}
+	// The console state starts out zeroed, so there is nothing to initialize
+	this->state = state;
+	ram[3] = ram[2] = ram[1] = ram[0] = state->ram;		// 2K of internam ram mirrored to other banks
+	rom[1] = rom[0] = state->prgROM[0];		// Lower 16k of ROM memory (default is mirrored)
+	romMapped = false;
+	state->prgROMUsed = true;
 }
 
 Memory::~Memory()
 {
-	delete[] ram[0];
-	if (rom[1] != rom[0])
-		delete[] rom[1];
-	delete[] rom[0];
 }
 
 uint8_t Memory::Read(const uint16_t address) const
@@ -30,9 +25,23 @@ uint8_t Memory::Read(const uint16_t address) const
 
 void Memory::Write(const uint16_t address, const uint8_t data)
 {
+	if ((address & 0xE000) && romMapped)
+		return;
 	*GetBytePtr(address) = data;
 }
 
+const uint8_t* Memory::GetReadPage(const uint16_t address)
+{
+	return GetBytePtr(address & 0xFF00);
+}
+
+uint8_t* Memory::GetWritePage(const uint16_t address)
+{
+	if ((address & 0xE000) && romMapped)
+		return NULL;		// Left to Write, which drops it
+	return GetBytePtr(address & 0xFF00);	// ROM is writable too, the same as Write
+}
+
 uint8_t* Memory::GetBytePtr(const uint16_t address) const
 {
 	int index;
@@ -52,18 +61,32 @@ uint8_t* Memory::GetBytePtr(const uint16_t address) const
 
 uint8_t* Memory::GetROMBuffer(const bool highBank)
 {
+	if (romMapped)
+	{
+		rom[1] = rom[0] = state->prgROM[0];		// Back to the copy in the console state
+		romMapped = false;
+		state->prgROMUsed = true;
+	}
 	if (highBank)
 	{
-		if (rom[1] == rom[0] || rom[1] == NULL)
-		{
-			// Allocate the upper 16k of memory
-			rom[1] = new uint8_t[SIZE_16K];
-		}
+		rom[1] = state->prgROM[1];		// Upper 16k of memory, no longer a mirror
 		return rom[1];
 	}
 	return rom[0];
 }
 
+void Memory::MapROM(const uint8_t* lowBank, const uint8_t* highBank)
+{
+	if (!lowBank | !highBank)
+		throw std::invalid_argument("Invalid NULL argument");
+
+	// Only ever read through, Write and GetWritePage check romMapped first
+	rom[0] = const_cast<uint8_t*>(lowBank);
+	rom[1] = const_cast<uint8_t*>(highBank);
+	romMapped = true;
+	state->prgROMUsed = false;
+}
+
 void Memory::Initialize(uint8_t* mem, const uint16_t size)
 {
 	for (int i = 0; i < size; i++)
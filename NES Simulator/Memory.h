@@ -1,23 +1,29 @@
 #pragma once
 #include "BusDevice.h"
+#include "ConsoleState.h"
 #include <cstdint>
 
 class Memory : public BusDevice
 {
 public:
-	Memory();
+	Memory(ConsoleState* state);
 	~Memory();
 
 private:
-	uint8_t* ram[4];
+	ConsoleState* state;
+	uint8_t* ram[4];		// Banks in the console state
 	uint8_t* rom[2];
+	bool romMapped;			// Banks point into a shared read-only image, writes to them are dropped
 
 	uint8_t* GetBytePtr(uint16_t address) const;
 
 public:
 	uint8_t Read(const uint16_t address) const override;
 	void Write(const uint16_t address, const uint8_t data) override;
+	const uint8_t* GetReadPage(const uint16_t address) override;
+	uint8_t* GetWritePage(const uint16_t address) override;
 	void Initialize(uint8_t* mem, const uint16_t size);
 	uint8_t* GetROMBuffer(const bool highBank = false);
+	void MapROM(const uint8_t* lowBank, const uint8_t* highBank);	// Runs the program ROM in place, same bank twice for 16k
 };
 
@@ -3,17 +3,30 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 
 NES::NES()
 {
 	sAppName = "NES Simulator";
+	currentPalette = 0;
+	threadedCode = false;
+#ifdef BUS_ACCESS_HEATMAP
+	showHeatmap = false;
+#endif
+	romFile = "F:\\Donkey Kong.nes";
 	// Construct our 'physical' screen
 	Construct(800, 480, 2, 2);
+	state = ConsoleState::Create();		// Everything the console is made of, in one block
+	memory = new Memory(state);
+	ppu = new PPU(state);
+#ifdef CPU_STATIC_BUS
+	bus = new NESBus(memory, ppu, memory);		// Internal RAM, PPU Registers, Program ROM
+#else
 	bus = new Bus();
-	memory = new Memory();
-	ppu = new PPU();
 	if (bus)
 	{
 		if (ppu)
@@ -25,12 +38,32 @@ NES::NES()
 			bus->RegisterDevice(memory, 0x8000, 8);		// Program ROM
 			bus->RegisterDevice(memory, 0x0000, 2);		// Internal RAM
 		}
+	}
+#endif
+	if (bus)
+	{
 		loader = new NESLoader(memory, ppu);
-		loader->LoadFile("F:\\Donkey Kong.nes");
-		cpu = new CPU_6502(bus);
+		if (!loader->MapFile(romFile))		// Shared with any other console running the same file
+			loader->LoadFile(romFile);
+		if (memory)
+			bus->RefreshPages(memory);		// Loading may have given the ROM its own upper bank or mapped it read-only
+		cpu = new CPU_6502(bus, state);
+		dma = new OAMDMA(bus, ppu, cpu);
+		bus->RegisterRegion(dma, 0x4014, 1);		// OAM DMA
 	}
 }
 
+NES::~NES()
+{
+	delete dma;
+	delete cpu;
+	delete loader;
+	delete bus;
+	delete ppu;
+	delete memory;
+	ConsoleState::Destroy(state);		// Last, everything above works on it in place
+}
+
 bool NES::OnUserCreate()
 {
 	const vector<CPU_6502::DisassembledInstruction>* instructionList = cpu->Disassemble(0x8000, 0x0FFF);
@@ -41,14 +74,48 @@ bool NES::OnUserCreate()
 	return true;
 }
 
+#if defined(CPU_OPCODE_PROFILE) || defined(BUS_ACCESS_HEATMAP)
+bool NES::OnUserDestroy()
+{
+#ifdef CPU_OPCODE_PROFILE
+	// Leave the opcode counts of the run next to the ROM
+	ofstream csv(romFile + ".opcodes.csv");
+	cpu->WriteOpCodeProfile(csv, CPU_6502::PROFILE_CSV);
+	ofstream json(romFile + ".opcodes.json");
+	cpu->WriteOpCodeProfile(json, CPU_6502::PROFILE_JSON);
+#endif
+#ifdef BUS_ACCESS_HEATMAP
+	// Same for the access counts of every address
+	ofstream heatmapCsv(romFile + ".heatmap.csv");
+	bus->WriteHeatmap(heatmapCsv, Bus::HEATMAP_CSV);
+	ofstream heatmapBinary(romFile + ".heatmap.bin", ios::binary);
+	bus->WriteHeatmap(heatmapBinary, Bus::HEATMAP_BINARY);
+#endif
+	return true;
+}
+#endif
+
 bool NES::OnUserUpdate(float fElapsedTime)
 {
-	static int currentPalette = 0;
 	olc::HWButton paletteCycle = GetKey(olc::Key::P);
 	if (paletteCycle.bPressed)
 	{
 		currentPalette = ++currentPalette % 8;
 	}
+	if (GetKey(olc::Key::C).bPressed)
+	{
+		cpu->SetCycleExact(!cpu->IsCycleExact());		// Clock then keeps the PPU in step with every cycle
+	}
+	if (GetKey(olc::Key::T).bPressed && cpu->SetThreadedCode(!threadedCode))
+	{
+		threadedCode = !threadedCode;		// Only flipped if this build has threaded code
+	}
+#ifdef BUS_ACCESS_HEATMAP
+	if (GetKey(olc::Key::H).bPressed)
+	{
+		showHeatmap = !showHeatmap;
+	}
+#endif
 
 #ifdef DEBUG
 	//olc::HWButton spaceStatus = GetKey(olc::Key::SPACE);
@@ -67,6 +134,11 @@ bool NES::OnUserUpdate(float fElapsedTime)
 
 	Clear(olc::BLUE);
 	DrawSprite(0, 0, ppu->GetScreen(), 2);
+#ifdef BUS_ACCESS_HEATMAP
+	if (showHeatmap)
+		DisplayHeatmap(520, 50);
+	else
+#endif
 	DisplayRegisters(520, 50);
 	DisplayPatternTables(517, 337, currentPalette);
 	return true;
@@ -85,12 +157,14 @@ void NES::DumpMemory(int32_t x, int32_t y, uint16_t memAddress, uint8_t width, u
 	// Memory Contents Columns
 	if (bus)
 	{
+		vector<uint8_t> row(width);
 		for (int i = 0; i < height; i++)
 		{
 			stringstream ss;
+			bus->PeekBlock(memAddress + i * width, row.data(), width);
 			for (int j = 0; j < width; j++)
 			{
-				ss << uppercase << setfill('0') << setw(2) << hex << (int)bus->Read(memAddress + i * width + j) << " ";
+				ss << uppercase << setfill('0') << setw(2) << hex << (int)row[j] << " ";
 			}
 			DrawString(x + 40, y + 10 * i, ss.str(), olc::WHITE);
 		}
@@ -187,6 +261,28 @@ void NES::DisplayPatternTables(int32_t x, int32_t y, int8_t paletteIndex)
 	DrawSprite(x + 137 + 7, y + 12, ppu->GetPatternTable(paletteIndex, false), 1);
 }
 
+#ifdef BUS_ACCESS_HEATMAP
+void NES::DisplayHeatmap(int32_t x, int32_t y)
+{
+	// One pixel per address, a row per page. Writes are red, reads green and opcode fetches blue,
+	// each on a log scale up to the busiest address of its kind.
+	const uint32_t* writes = bus->GetHeatmap(Bus::HEATMAP_WRITES);
+	const uint32_t* reads = bus->GetHeatmap(Bus::HEATMAP_READS);
+	const uint32_t* fetches = bus->GetHeatmap(Bus::HEATMAP_FETCHES);
+	double writeScale = 255.0 / log(2.0 + *max_element(writes, writes + 0x10000));
+	double readScale = 255.0 / log(2.0 + *max_element(reads, reads + 0x10000));
+	double fetchScale = 255.0 / log(2.0 + *max_element(fetches, fetches + 0x10000));
+
+	olc::Sprite heatmap(256, 256);
+	for (int address = 0; address < 0x10000; address++)
+	{
+		heatmap.SetPixel(address & 0xFF, address >> 8, olc::Pixel((uint8_t)(writeScale * log(1.0 + writes[address])),
+			(uint8_t)(readScale * log(1.0 + reads[address])), (uint8_t)(fetchScale * log(1.0 + fetches[address]))));
+	}
+	DrawSprite(x, y, &heatmap, 1);
+}
+#endif
+
 //void NES::DisplayCode(int32_t x, int32_t y, const CPU_6502::DisassembleInfo* data, uint8_t lines, uint16_t pc)
 //{
 //	for (int i = 0; i < lines; i++)
@@ -201,9 +297,20 @@ void NES::Clock()
 
 	do
 	{
-		vSync = ppu->Clock();
-		vSync |= ppu->Clock();
-		vSync |= ppu->Clock();
-		cpu->Clock();
+		uint32_t cycles;
+		if (cpu->IsCycleExact())
+		{
+			// One bus access per cpu cycle, so keep the PPU in step with every one of them
+			cpu->Clock();
+			cycles = 3;
+		}
+		else
+		{
+			// Run one whole instruction, then let the PPU catch up (3 ppu cycles for every cpu cycle). Nothing else
+			// is scheduled yet, so an idle loop can be skipped on to the end of the frame, but not past it.
+			cycles = cpu->RunCycles(1, ppu->CyclesUntilVSync() / 3) * 3;
+		}
+		while (cycles--)
+			vSync |= ppu->Clock();
 	} while (!vSync);
 }
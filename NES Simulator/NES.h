@@ -1,10 +1,12 @@
 #pragma once
 #include "olcPixelGameEngine.h"
 #include "Bus.h"
+#include "ConsoleState.h"
 #include "Memory.h"
 #include "CPU_6502.h"
 #include "PPU.h"
 #include "NESLoader.h"
+#include "OAMDMA.h"
 
 //#define DEBUG
 
@@ -12,22 +14,37 @@ class NES : public olc::PixelGameEngine
 {
 public:
 	NES();
+	~NES();
 
 private:
+	ConsoleState* state;
 	CPU_6502* cpu;	
-	Bus* bus;
+	CPU_6502::BusType* bus;
 	PPU* ppu;
 	Memory* memory;
 	NESLoader* loader;
+	OAMDMA* dma;
+	int currentPalette;
+	bool threadedCode;
+#ifdef BUS_ACCESS_HEATMAP
+	bool showHeatmap;
+#endif
+	string romFile;
 
 public:
 	bool OnUserCreate() override;
 	bool OnUserUpdate(float fElapsedTime) override;
+#if defined(CPU_OPCODE_PROFILE) || defined(BUS_ACCESS_HEATMAP)
+	bool OnUserDestroy() override;
+#endif
 
 private:
 	void DumpMemory(int32_t x, int32_t y, uint16_t memAddress, uint8_t width, uint8_t height);
 	void DisplayRegisters(int32_t x, int32_t y);
 	void DisplayPatternTables(int32_t x, int32_t y, int8_t paletteIndex);
+#ifdef BUS_ACCESS_HEATMAP
+	void DisplayHeatmap(int32_t x, int32_t y);
+#endif
 //	void DisplayCode(int32_t x, int32_t y, const CPU_6502::DisassembleInfo* data, uint8_t lines, uint16_t pc);
 	void Clock();
 };
@@ -0,0 +1,11 @@
+#pragma once
+#include "StaticBus.h"
+#include "Memory.h"
+#include "PPU.h"
+
+// The NES memory map (see CPU_STATIC_BUS)
+typedef StaticBus<
+	BusRegion<Memory, 0x0000, 0x2000>,	// Internal RAM
+	BusRegion<PPU, 0x2000, 0x2000>,		// PPU Registers
+	BusRegion<Memory, 0x8000, 0x8000>	// Program ROM
+> NESBus;
@@ -80,3 +80,29 @@ bool NESLoader::LoadFile(string fileName)
 	return result;
 }
 
+bool NESLoader::MapFile(string fileName)
+{
+	shared_ptr<const ROMImage> file = ROMImage::Open(fileName);
+	if (!file || file->GetSize() < 16)
+		return false;
+	const uint8_t* header = file->GetData();
+
+	// Same layout as LoadFile reads: header, optional trainer, program ROM (16 or 32K), then CHR ROM
+	bool b32k = header[4] == 2 ? true : false;
+	bool bChrROM = header[5] ? true : false;
+	size_t offset = 16;
+	if (header[6] & 0x08)
+		offset += 512;
+
+	size_t programSize = b32k ? 0x8000 : 0x4000;
+	if (offset + programSize + (bChrROM ? 0x2000 : 0) > file->GetSize())
+		return false;		// Truncated
+
+	const uint8_t* program = header + offset;
+	memory->MapROM(program, b32k ? program + 0x4000 : program);
+	if (bChrROM)
+		ppu->MapChrROM(program + programSize);
+
+	image = file;
+	return true;
+}
@@ -1,8 +1,10 @@
 #pragma once
 #include "Memory.h"
 #include "PPU.h"
+#include "ROMImage.h"
 #include <string>
 #include <cstdint>
+#include <memory>
 
 using namespace std;
 
@@ -12,9 +14,11 @@ public:
 	NESLoader(Memory* memory, PPU* ppu);
 
 	bool LoadFile(string fileName);
+	bool MapFile(string fileName);		// Runs PRG and CHR ROM straight from a mapping of the file shared by every console using it
 
 private:
 	Memory* memory;
 	PPU* ppu;
+	shared_ptr<const ROMImage> image;		// Kept mapped for as long as the loader lives
 };
 
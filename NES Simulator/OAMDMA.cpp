@@ -0,0 +1,26 @@
+#include "OAMDMA.h"
+#include <cstdint>
+#include <stdexcept>
+
+OAMDMA::OAMDMA(Bus* bus, PPU* ppu, CPU_6502* cpu)
+{
+	if (!bus | !ppu | !cpu)
+		throw std::invalid_argument("Invalid NULL argument");
+
+	this->bus = bus;
+	this->ppu = ppu;
+	this->cpu = cpu;
+}
+
+uint8_t OAMDMA::Read(uint16_t address) const
+{
+	return 0;		// Write only
+}
+
+void OAMDMA::Write(uint16_t address, uint8_t data)
+{
+	uint8_t page[256];
+	bus->ReadBlock(data << 8, page, 256);
+	ppu->WriteOAM(page);
+	cpu->Stall(DMA_CYCLES, true);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "BusDevice.h"
+#include "Bus.h"
+#include "PPU.h"
+#include "CPU_6502.h"
+#include <cstdint>
+
+// OAM DMA ($4014)
+//
+// Writing page number xx copies $xx00-$xxFF into OAM, the same as 256 writes to OAMDATA. The CPU is halted
+// while it runs: a cycle for the write to finish, another to line up with a read cycle when the halt starts
+// on an odd cycle, then a read and a write per byte, 513 or 514 cycles in all. The page is taken with a single
+// ReadBlock, which is one memcpy for RAM and ROM, and the halt is charged to the CPU in one go instead of
+// being run a cycle at a time.
+class OAMDMA : public BusDevice
+{
+public:
+	OAMDMA(Bus* bus, PPU* ppu, CPU_6502* cpu);
+
+	uint8_t Read(uint16_t address) const override;
+	void Write(uint16_t address, uint8_t data) override;
+
+private:
+	static const uint16_t DMA_CYCLES = 513;		// Without the alignment cycle
+
+	Bus* bus;
+	PPU* ppu;
+	CPU_6502* cpu;
+};
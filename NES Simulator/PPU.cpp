@@ -1,12 +1,27 @@
 #include "PPU.h"
 #include <cstdint>
 #include <stdexcept>
+#include <cstring>
+#include <algorithm>
 
-PPU::PPU() : screen{ {256, 240}, {256, 240} }
+static ConsoleState* CheckState(ConsoleState* state)
+{
+	if (!state)
+		throw std::invalid_argument("Invalid NULL argument");
+	return state;
+}
+
+PPU::PPU(ConsoleState* state) : screen{ {256, 240}, {256, 240} }, patternTableSprite(128, 128),
+	scanline(CheckState(state)->ppu.scanline), cycle(state->ppu.cycle),
+	vramAddress(state->ppu.vramAddress), writeLatch(state->ppu.writeLatch), nametableMap(state->ppu.nametableMap),
+	chrROMUsed(state->chrROMUsed), registers(state->ppu.registers), colorData(state->ppu.colorData), OAM(state->oam)
 {
 	scanline = -1;
 	cycle = 0;
+	vramAddress = 0;
+	writeLatch = false;
 	backBuffer = 0;
+	dirtyPages = ~(uint64_t)0;		// Nothing has been captured yet
 
 	registers[PPUCTRL] = 0x00;
 	registers[PPUMASK] = 0x00;
@@ -16,18 +31,16 @@ PPU::PPU() : screen{ {256, 240}, {256, 240} }
 	registers[PPUADDR] = 0x00;
 	registers[PPUDATA] = 0x00;
 
-	chrROM = new uint8_t[SIZE_16K];
-	videoRAM = new uint8_t[SIZE_2K];
-	videoRAM2 = NULL;
+	chrROM = state->chrROM;
+	videoRAM = state->videoRAM;
+	videoRAM2 = state->videoRAM2;
 
 	patternTable0 = chrROM;
 	patternTable1 = chrROM + SIZE_4K;
-	MapNametables(nametableType);
+	chrMapped = false;
+	chrROMUsed = true;
+	MapNametables(NAMETABLE_MAP_VERTICAL);
 
-	for (int i = 0; i < 28; i++)
-	{
-		colorData[i] = 0;
-	}
 	*paletteRAM[0] = 0x0d;
 	*paletteRAM[1] = 0x02;
 	*paletteRAM[2] = 0x06;
@@ -36,10 +49,6 @@ PPU::PPU() : screen{ {256, 240}, {256, 240} }
 
 PPU::~PPU()
 {
-	delete[] chrROM;
-	delete[] videoRAM;
-	if (videoRAM2)
-		delete[] videoRAM2;
 }
 
 void PPU::Reset()
@@ -54,23 +63,77 @@ void PPU::Reset()
 	registers[PPUSCROLL] = 0x00;
 	//registers[PPUADDR] = registers[PPUADDR];	// Unchanged
 	registers[PPUDATA] = 0x00;
+	writeLatch = false;
+}
+
+void PPU::OnStateLoaded()
+{
+	MapNametables((NametableMapType)nametableMap);
+	dirtyPages = ~(uint64_t)0;
 }
 
 uint8_t PPU::Read(uint16_t address) const
 {
+	if ((address & 0x0007) == PPUSTATUS)
+		writeLatch = false;
 	return registers[address & 0x0007];		// The same 8 register bytes are mirrored across the entire 8k of address space
 }
 
 void PPU::Write(uint16_t address, uint8_t data)
 {
 	registers[address & 0x0007] = data;		// The same 8 register bytes are mirrored across the entire 8k of address space
+	switch (address & 0x0007)
+	{
+	case PPUSCROLL:
+		writeLatch = !writeLatch;
+		break;
+
+	case PPUADDR:		// High byte first
+		if (writeLatch)
+			vramAddress = (vramAddress & 0x3F00) | data;
+		else
+			vramAddress = (vramAddress & 0x00FF) | ((data & 0x3F) << 8);
+		writeLatch = !writeLatch;
+		break;
+
+	case PPUDATA:
+		PPUWrite(vramAddress, data);
+		vramAddress = (vramAddress + (registers[PPUCTRL] & 0x04 ? 32 : 1)) & 0x3FFF;		// Across or down a row
+		break;
+	}
+}
+
+uint8_t PPU::Peek(uint16_t address) const
+{
+	return registers[address & 0x0007];
 }
 
 uint8_t* PPU::GetChrROMBuffer()
 {
+	if (chrMapped)
+	{
+		patternTable0 = chrROM;		// Back to the copy in the console state
+		patternTable1 = chrROM + SIZE_4K;
+		chrMapped = false;
+		chrROMUsed = true;
+		dirtyPages |= 0x00000000FFFFFFFF;		// $0000-$1FFF, the pattern tables
+	}
 	return chrROM;
 }
 
+void PPU::MapChrROM(const uint8_t* data)
+{
+	if (!data)
+		throw std::invalid_argument("Invalid NULL argument");
+
+	// Only ever read through, PPUWrite checks chrMapped first
+	patternTable0 = const_cast<uint8_t*>(data);
+	patternTable1 = const_cast<uint8_t*>(data + SIZE_4K);
+	chrMapped = true;
+	chrROMUsed = false;
+	dirtyPages |= 0x00000000FFFFFFFF;		// $0000-$1FFF, the pattern tables
+}
+
 const olc::Sprite* PPU::GetScreen() const
 {
 	return &screen[(backBuffer + 1) % 2];
@@ -94,9 +157,14 @@ bool PPU::Clock()
 	return result;
 }
 
+uint32_t PPU::CyclesUntilVSync() const
+{
+	return (262 - cycle) + (340 - scanline) * 262;
+}
+
 const olc::Sprite* PPU::GetPatternTable(uint8_t paletteIndex, bool left) const
 {
-	static olc::Sprite sprite(128, 128);
+	olc::Sprite& sprite = patternTableSprite;
 	olc::Pixel* display = sprite.GetData();
 	uint8_t* palette = paletteRAM[paletteIndex * 4];
 	uint8_t* patternTable = left ? patternTable0 : patternTable1;
@@ -133,6 +201,7 @@ olc::Pixel PPU::GetPaletteColor(int palette, int index) const
 
 void PPU::MapNametables(NametableMapType type)
 {
+	dirtyPages |= 0xFFFFFFFF00000000;		// $2000-$3FFF, the nametables and their mirrors
 	switch (type)
 	{
 	case NAMETABLE_MAP_VERTICAL:
@@ -150,8 +219,6 @@ void PPU::MapNametables(NametableMapType type)
 		break;
 
 	case NAMETABLE_MAP_FOURSCREEN:
-		// Allocate additional memory for nametables
-		videoRAM2 = new uint8_t[SIZE_2K];
 		nametable0 = videoRAM;
 		nametable1 = videoRAM + SIZE_1K;
 		nametable2 = videoRAM2;
@@ -161,6 +228,7 @@ void PPU::MapNametables(NametableMapType type)
 	default:
 		throw std::invalid_argument("Invalid NametableMapType");
 	}
+	nametableMap = type;
 }
 
 uint8_t PPU::PPURead(uint16_t address) const
@@ -170,9 +238,57 @@ uint8_t PPU::PPURead(uint16_t address) const
 
 void PPU::PPUWrite(uint16_t address, uint8_t data)
 {
+	if (chrMapped && !(address & 0x2000))
+		return;
+	dirtyPages |= (uint64_t)1 << ((address >> 8) & 0x3F);
 	*GetAddressPtr(address) = data;
 }
 
+void PPU::WriteOAM(const uint8_t* data)
+{
+	// OAMADDR wraps around, so a copy that doesn't start at 0 is split in two
+	uint8_t start = registers[OAMADDR];
+	memcpy(&OAM[start], data, 256 - start);
+	memcpy(OAM, data + 256 - start, start);
+}
+
+bool PPU::IsVideoPageDirty(uint16_t address) const
+{
+	return (dirtyPages >> ((address >> 8) & 0x3F)) & 1;
+}
+
+uint32_t PPU::CaptureVideoPages(uint8_t* image)
+{
+	// Mirrored pages share memory, so every page backed by the same memory as a dirty page is copied
+	const uint8_t* dirtyMemory[64];
+	int dirtyCount = 0;
+	for (int page = 0; page < 64; page++)
+	{
+		if ((dirtyPages >> page) & 1)
+			dirtyMemory[dirtyCount++] = GetAddressPtr(page << 8);
+	}
+
+	uint32_t copied = 0;
+	for (int page = 0; page < 64 && dirtyCount; page++)
+	{
+		uint16_t address = page << 8;
+		const uint8_t* memory = GetAddressPtr(address);
+		if (std::find(dirtyMemory, dirtyMemory + dirtyCount, memory) == dirtyMemory + dirtyCount)
+			continue;
+		if (GetAddressPtr(address + 0xFF) == memory + 0xFF)
+			memcpy(image + address, memory, 0x100);
+		else
+		{
+			// Palette entries are scattered through colorData and mirrored across the page
+			for (int i = 0; i < 0x100; i++)
+				image[address + i] = PPURead(address + i);
+		}
+		copied++;
+	}
+	dirtyPages = 0;
+	return copied;
+}
+
 uint8_t* PPU::GetAddressPtr(uint16_t address) const
 {
 	uint16_t offset = address & 0x0FFF;
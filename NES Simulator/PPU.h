@@ -1,5 +1,6 @@
 #pragma once
 #include "BusDevice.h"
+#include "ConsoleState.h"
 #include "olcPixelGameEngine.h"
 #include <cstdint>
 
@@ -15,36 +16,51 @@
 class PPU : public BusDevice
 {
 public:
-	PPU();
+	PPU(ConsoleState* state);
 	~PPU();
 
 	enum NametableMapType { NAMETABLE_MAP_VERTICAL, NAMETABLE_MAP_HORIZONTAL, NAMETABLE_MAP_ONESCREEN, NAMETABLE_MAP_FOURSCREEN };
 
 	void Reset();
+	void OnStateLoaded();		// Maps the nametables of a state copied in, every page counts as dirty
 	uint8_t Read(uint16_t address) const override;
 	void Write(uint16_t address, uint8_t data) override;
+	uint8_t Peek(uint16_t address) const override;
 	uint8_t* GetChrROMBuffer();
+	void MapChrROM(const uint8_t* data);		// Reads the 8k of pattern tables in place, writes to them are dropped
 	const olc::Sprite* GetScreen() const;
 	bool Clock();
+	uint32_t CyclesUntilVSync() const;		// PPU cycles until Clock() next returns true
 	const olc::Sprite* GetPatternTable(uint8_t palette, bool left = true) const;
 	olc::Pixel GetPaletteColor(int palette, int index) const;
+	bool IsVideoPageDirty(uint16_t address) const;		// Page of the PPU address space was written or remapped since the last capture
+	uint32_t CaptureVideoPages(uint8_t* image);		// Same as Bus::CapturePages for the 16k PPU address space
+	void WriteOAM(const uint8_t* data);		// 256 bytes from OAM DMA, written from OAMADDR on like writes to OAMDATA
 
 private:
 	olc::Sprite screen[2];
+	mutable olc::Sprite patternTableSprite;		// Render target for GetPatternTable()
 	int backBuffer;
 
-	int16_t scanline;
-	int16_t cycle;
+	// Views into the console state
+	int16_t& scanline;
+	int16_t& cycle;
+	uint16_t& vramAddress;
+	bool& writeLatch;			// Cleared by reading PPUSTATUS
+	uint8_t& nametableMap;		// NametableMapType
+	bool& chrROMUsed;			// Pattern tables are in the console state, not chrMapped
 
-	uint8_t registers[8];
-	uint8_t colorData[28];
-	uint8_t OAM[256];
+	uint8_t* registers;		// 8 bytes
+	uint8_t* colorData;		// 28 bytes
+	uint8_t* OAM;			// 256 bytes
+	uint64_t dirtyPages;		// One bit per 256 byte page of the PPU address space, set by VRAM writes
 	uint8_t* chrROM;
 	uint8_t* videoRAM;
-	uint8_t* videoRAM2;		// Pointer for additional video RAM if needed (4-Screen mapping)
+	uint8_t* videoRAM2;		// Additional video RAM for 4-Screen mapping
 
 	uint8_t* patternTable0;
 	uint8_t* patternTable1;
+	bool chrMapped;				// Pattern tables point into a shared read-only image
 	uint8_t* nametable0;
 	uint8_t* nametable1;
 	uint8_t* nametable2;
@@ -62,8 +78,6 @@ private:
 							{236, 238, 236}, {76, 154, 236}, {120, 124, 236}, {176, 98, 236}, {228, 84, 236}, {236, 88, 180},  {236, 106, 100}, {212, 136, 32}, {160, 170, 0}, {116, 196, 0}, {76, 208, 32}, {56, 204, 108}, {56, 180, 204}, {60, 60, 60}, {0, 0, 0}, {0, 0, 0},
 							{236, 238, 236}, {168, 204, 236}, {188, 188, 236}, {212, 178, 236}, {236, 174, 236}, {236, 174, 212}, {236, 180, 176}, {228, 196, 144}, {204, 210, 120}, {180, 222, 120}, {168, 226, 144}, {152, 226, 180}, {160, 214, 228}, {160, 162, 160}, {0, 0, 0}, {0, 0, 0} };
 
-	NametableMapType nametableType = NAMETABLE_MAP_VERTICAL;
-
 	void MapNametables(NametableMapType type);
 	uint8_t PPURead(uint16_t address) const;
 	void PPUWrite(uint16_t address, uint8_t data);
@@ -0,0 +1,98 @@
+#include "ROMImage.h"
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+mutex ROMImage::cacheLock;
+map<string, weak_ptr<const ROMImage>> ROMImage::cache;
+
+ROMImage::ROMImage(const string& fileName, const uint8_t* data, size_t size)
+{
+	this->fileName = fileName;
+	this->data = data;
+	this->size = size;
+}
+
+ROMImage::~ROMImage()
+{
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, size);
+#endif
+}
+
+shared_ptr<const ROMImage> ROMImage::Open(const string& fileName)
+{
+	lock_guard<mutex> lock(cacheLock);
+	auto cached = cache.find(fileName);
+	if (cached != cache.end())
+	{
+		shared_ptr<const ROMImage> image = cached->second.lock();
+		if (image)
+			return image;
+	}
+
+	// The view outlives the handles, only the mapping itself has to be kept
+	const uint8_t* data = NULL;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+	{
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+		{
+			data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			size = (size_t)fileSize.QuadPart;
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	int file = open(fileName.c_str(), O_RDONLY);
+	if (file < 0)
+		return NULL;
+	struct stat fileStat;
+	if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+	{
+		void* memory = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (memory != MAP_FAILED)
+		{
+			data = (const uint8_t*)memory;
+			size = (size_t)fileStat.st_size;
+		}
+	}
+	close(file);
+#endif
+	if (!data)
+		return NULL;
+
+	shared_ptr<const ROMImage> image(new ROMImage(fileName, data, size), Release);
+	cache[fileName] = image;
+	return image;
+}
+
+void ROMImage::Release(const ROMImage* image)
+{
+	{
+		lock_guard<mutex> lock(cacheLock);
+		auto cached = cache.find(image->fileName);
+		if (cached != cache.end() && cached->second.expired())		// Not if the file was opened again since
+			cache.erase(cached);
+	}
+	delete image;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// Read-only memory-mapped ROM file
+//
+// The file is mapped, never read, so its pages come straight from the OS file cache and are only made
+// resident as they are touched. Every Open of the same file name while an image is still held returns the
+// same mapping, so any number of consoles running one title share a single copy of it. The mapping is
+// released with the last reference, which also takes the file out of the cache.
+class ROMImage
+{
+public:
+	~ROMImage();
+
+	static std::shared_ptr<const ROMImage> Open(const std::string& fileName);	// NULL if the file can't be mapped
+
+	const uint8_t* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+	ROMImage(const std::string& fileName, const uint8_t* data, size_t size);
+	ROMImage(const ROMImage&) = delete;
+	ROMImage& operator=(const ROMImage&) = delete;
+
+	std::string fileName;
+	const uint8_t* data;
+	size_t size;
+
+	static std::mutex cacheLock;
+	static std::map<std::string, std::weak_ptr<const ROMImage>> cache;
+
+	static void Release(const ROMImage* image);		// Deleter of the shared images
+};
@@ -0,0 +1,166 @@
+#pragma once
+#include "Bus.h"
+#include "BusDevice.h"
+#include <cstdint>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <stdexcept>
+
+#if defined(_MSC_VER)
+#define STATIC_BUS_NOINLINE __declspec(noinline)
+#else
+#define STATIC_BUS_NOINLINE __attribute__((noinline))	// Keeps Read and Write small enough to inline everywhere
+#endif
+
+// A device of type Device at length bytes from startAddress
+template<class Device, uint16_t startAddress, uint32_t length>
+struct BusRegion
+{
+	typedef Device DeviceType;
+	static const uint16_t START = startAddress;
+	static const uint32_t END = startAddress + length;	// One past the last address
+	static const uint32_t LENGTH = length;
+};
+
+// Statically dispatched bus
+//
+// The regions are fixed at compile time, so an access that misses the page table is resolved by a chain of
+// range checks the compiler folds into a switch, and ends in a direct call to the device's own Read or Write
+// that can be inlined. The range checks are kept out of line so only the page table lookup is inlined into
+// the CPU. Calls made through a plain Bus pointer still work: the regions are registered with
+// the Bus as well, and RegisterRegion can add more devices in the addresses left free, which are reached the
+// usual way after the static regions.
+template<class... Regions>
+class StaticBus : public Bus
+{
+public:
+	StaticBus(typename Regions::DeviceType*... devices);
+
+	uint8_t Read(uint16_t address) const;
+	uint8_t Fetch(uint16_t address) const;
+	void Write(uint16_t address, uint8_t data);
+
+private:
+	typedef std::tuple<Regions...> RegionList;
+	template<size_t index>
+	using Index = std::integral_constant<size_t, index>;
+
+	std::tuple<typename Regions::DeviceType*...> devices;
+
+	template<size_t index>
+	void Register(Index<index>);
+	void Register(Index<sizeof...(Regions)>) {}
+
+	STATIC_BUS_NOINLINE uint8_t ReadRegions(uint16_t address) const;
+	STATIC_BUS_NOINLINE void WriteRegions(uint16_t address, uint8_t data);
+
+	template<size_t index>
+	uint8_t ReadRegion(uint16_t address, Index<index>) const;
+	uint8_t ReadRegion(uint16_t address, Index<sizeof...(Regions)>) const { return ReadDevice(address); }
+
+	template<size_t index>
+	void WriteRegion(uint16_t address, uint8_t data, Index<index>);
+	void WriteRegion(uint16_t address, uint8_t data, Index<sizeof...(Regions)>) { WriteDevice(address, data); }
+};
+
+
+template<class... Regions>
+StaticBus<Regions...>::StaticBus(typename Regions::DeviceType*... devices) : devices(devices...)
+{
+	Register(Index<0>());
+}
+
+template<class... Regions>
+template<size_t index>
+void StaticBus<Regions...>::Register(Index<index>)
+{
+	typedef typename std::tuple_element<index, RegionList>::type Region;
+	if (!std::get<index>(devices))
+		throw std::invalid_argument("Invalid NULL argument");
+	if (!RegisterRegion(std::get<index>(devices), Region::START, Region::LENGTH))
+		throw std::invalid_argument("Bus regions overlap or are out of range");
+	Register(Index<index + 1>());
+}
+
+template<class... Regions>
+inline uint8_t StaticBus<Regions...>::Read(uint16_t address) const
+{
+#ifdef BUS_ACCESS_HEATMAP
+	heatmap[(HEATMAP_READS << 16) | address]++;
+#endif
+	const uint8_t* const page = readPages[address >> 8];
+	if (page)
+		return page[address & 0xFF];
+	return ReadRegions(address);
+}
+
+template<class... Regions>
+inline uint8_t StaticBus<Regions...>::Fetch(uint16_t address) const
+{
+#ifdef BUS_ACCESS_HEATMAP
+	heatmap[(HEATMAP_FETCHES << 16) | address]++;
+	const uint8_t* const page = readPages[address >> 8];
+	if (page)
+		return page[address & 0xFF];
+	return ReadRegions(address);
+#else
+	return Read(address);
+#endif
+}
+
+template<class... Regions>
+inline void StaticBus<Regions...>::Write(uint16_t address, uint8_t data)
+{
+#ifdef BUS_ACCESS_HEATMAP
+	heatmap[(HEATMAP_WRITES << 16) | address]++;
+#endif
+	if (trackedBlocks[address >> 12])
+		Invalidate(address);
+	dirtyPages[address >> 14] |= (uint64_t)1 << ((address >> 8) & 0x3F);
+	uint8_t* const page = writePages[address >> 8];
+	if (page)
+		page[address & 0xFF] = data;
+	else
+		WriteRegions(address, data);
+}
+
+template<class... Regions>
+uint8_t StaticBus<Regions...>::ReadRegions(uint16_t address) const
+{
+	if (watchedPages[address >> 8] & WATCH_READ)
+		return ReadWatched(address);
+	return ReadRegion(address, Index<0>());
+}
+
+template<class... Regions>
+void StaticBus<Regions...>::WriteRegions(uint16_t address, uint8_t data)
+{
+	if (watchedPages[address >> 8] & WATCH_WRITE)
+		WriteWatched(address, data);
+	else
+		WriteRegion(address, data, Index<0>());
+}
+
+template<class... Regions>
+template<size_t index>
+inline uint8_t StaticBus<Regions...>::ReadRegion(uint16_t address, Index<index>) const
+{
+	typedef typename std::tuple_element<index, RegionList>::type Region;
+	typedef typename Region::DeviceType Device;
+	if (address >= Region::START && address < Region::END)
+		return std::get<index>(devices)->Device::Read(address);		// Qualified, so there's no virtual call
+	return ReadRegion(address, Index<index + 1>());
+}
+
+template<class... Regions>
+template<size_t index>
+inline void StaticBus<Regions...>::WriteRegion(uint16_t address, uint8_t data, Index<index>)
+{
+	typedef typename std::tuple_element<index, RegionList>::type Region;
+	typedef typename Region::DeviceType Device;
+	if (address >= Region::START && address < Region::END)
+		std::get<index>(devices)->Device::Write(address, data);
+	else
+		WriteRegion(address, data, Index<index + 1>());
+}